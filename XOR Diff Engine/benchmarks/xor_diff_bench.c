@@ -0,0 +1,732 @@
+/* =============================================================================
+ * XOR DIFF ENGINE - Benchmark Harness
+ * =============================================================================
+ *
+ * Reproducible workloads for performance and flash benchmarks. Build it
+ * against the engine library, e.g.
+ *   cc -O2 benchmarks/xor_diff_bench.c <engine library> -o xor_diff_bench
+ * Every result is printed as one JSON object per line so runs can be
+ * compared and gated in CI.
+ *
+ * Usage:
+ *   xor_diff_bench [--flash] [--op NAME] [--max-size BYTES]
+ *                  [--min-time-ms MS] [--pair OLD.bin NEW.bin]...
+ *
+ * Workloads:
+ * - Synthetic images from 1 KB to 256 MB (capped by --max-size) with
+ *   0.1%, 1% and 10% changed bytes, plus a shifted insert near the start
+ * - Real firmware pairs given with --pair
+ *
+ * Flash operations run against a simulated NOR part that enforces
+ * erase-before-program semantics and single-page programs, counts
+ * erases/programs and models their latency. Images above the in-memory
+ * patch cap are flash-applied through the streaming API with a simple
+ * read/erase/program write-back driver.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+/* The public API header ships as main_api.c in this tree */
+#include "../main_api.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* =============================================================================
+ * SIMULATED NOR FLASH
+ * =============================================================================
+ */
+
+#define NOR_SECTOR_SIZE      4096
+#define NOR_PAGE_SIZE        256
+#define NOR_ERASE_US         40000.0  /* Per sector */
+#define NOR_PROGRAM_PAGE_US  700.0    /* Per page */
+
+typedef struct {
+    uint8_t* mem;
+    size_t size;
+    uint64_t erases;
+    uint64_t programs;
+    uint64_t program_bytes;
+    double busy_us;             /* Modeled device busy time */
+} nor_sim_t;
+
+static xor_diff_result_t nor_erase(void* flash_addr, size_t size, void* user_data) {
+    nor_sim_t* nor = (nor_sim_t*)user_data;
+    uint8_t* addr = (uint8_t*)flash_addr;
+
+    if (addr < nor->mem || addr + size > nor->mem + nor->size ||
+        (size_t)(addr - nor->mem) % NOR_SECTOR_SIZE != 0 ||
+        size % NOR_SECTOR_SIZE != 0) {
+        return XOR_DIFF_ERROR_FLASH_WRITE;
+    }
+
+    memset(addr, 0xFF, size);
+    nor->erases += size / NOR_SECTOR_SIZE;
+    nor->busy_us += (double)(size / NOR_SECTOR_SIZE) * NOR_ERASE_US;
+    return XOR_DIFF_SUCCESS;
+}
+
+static xor_diff_result_t nor_write(void* flash_addr, const void* data,
+                                   size_t size, void* user_data) {
+    nor_sim_t* nor = (nor_sim_t*)user_data;
+    uint8_t* addr = (uint8_t*)flash_addr;
+    const uint8_t* src = (const uint8_t*)data;
+
+    if (addr < nor->mem || addr + size > nor->mem + nor->size || size == 0 ||
+        (size_t)(addr - nor->mem) / NOR_PAGE_SIZE !=
+            ((size_t)(addr - nor->mem) + size - 1) / NOR_PAGE_SIZE) {
+        return XOR_DIFF_ERROR_FLASH_WRITE;  /* Programs must stay in one page */
+    }
+
+    /* NOR programming can only clear bits */
+    for (size_t i = 0; i < size; i++) {
+        if (src[i] & ~addr[i]) {
+            return XOR_DIFF_ERROR_FLASH_WRITE;
+        }
+        addr[i] &= src[i];
+    }
+
+    nor->programs++;
+    nor->program_bytes += size;
+    nor->busy_us += NOR_PROGRAM_PAGE_US;
+    return XOR_DIFF_SUCCESS;
+}
+
+/* Program a range page by page, skipping pages left fully erased */
+static xor_diff_result_t nor_program(nor_sim_t* nor, uint8_t* addr,
+                                     const uint8_t* data, size_t size) {
+    while (size > 0) {
+        size_t in_page = NOR_PAGE_SIZE - (size_t)(addr - nor->mem) % NOR_PAGE_SIZE;
+        size_t n = size < in_page ? size : in_page;
+        bool erased = true;
+        for (size_t i = 0; i < n && erased; i++) {
+            erased = data[i] == 0xFF;
+        }
+        if (!erased) {
+            xor_diff_result_t status = nor_write(addr, data, n, nor);
+            if (status != XOR_DIFF_SUCCESS) {
+                return status;
+            }
+        }
+        addr += n;
+        data += n;
+        size -= n;
+    }
+    return XOR_DIFF_SUCCESS;
+}
+
+/* Write-back target for streamed apply: a minimal flash driver that
+ * programs in place when the new bytes only clear bits and otherwise
+ * erases the sector and reprograms it from a RAM copy */
+typedef struct {
+    nor_sim_t* nor;
+    uint8_t sector[NOR_SECTOR_SIZE];
+} nor_stream_t;
+
+static xor_diff_result_t nor_stream_read(uint64_t offset, void* buffer, size_t size,
+                                         void* user_data) {
+    nor_stream_t* ns = (nor_stream_t*)user_data;
+
+    if (offset + size > ns->nor->size) {
+        return XOR_DIFF_ERROR_FLASH_WRITE;
+    }
+    memcpy(buffer, ns->nor->mem + offset, size);
+    return XOR_DIFF_SUCCESS;
+}
+
+static xor_diff_result_t nor_stream_write(uint64_t offset, const void* data, size_t size,
+                                          void* user_data) {
+    nor_stream_t* ns = (nor_stream_t*)user_data;
+    const uint8_t* src = (const uint8_t*)data;
+    xor_diff_result_t status = XOR_DIFF_SUCCESS;
+
+    if (offset + size > ns->nor->size) {
+        return XOR_DIFF_ERROR_FLASH_WRITE;
+    }
+    while (status == XOR_DIFF_SUCCESS && size > 0) {
+        size_t in_sector = (size_t)(offset % NOR_SECTOR_SIZE);
+        size_t n = NOR_SECTOR_SIZE - in_sector < size ? NOR_SECTOR_SIZE - in_sector : size;
+        uint8_t* sector = ns->nor->mem + (offset - in_sector);
+        bool needs_erase = false;
+
+        for (size_t i = 0; i < n && !needs_erase; i++) {
+            needs_erase = (src[i] & ~sector[in_sector + i]) != 0;
+        }
+        if (needs_erase) {
+            memcpy(ns->sector, sector, NOR_SECTOR_SIZE);
+            memcpy(ns->sector + in_sector, src, n);
+            status = nor_erase(sector, NOR_SECTOR_SIZE, ns->nor);
+            if (status == XOR_DIFF_SUCCESS) {
+                status = nor_program(ns->nor, sector, ns->sector, NOR_SECTOR_SIZE);
+            }
+        } else if (memcmp(sector + in_sector, src, n) != 0) {
+            status = nor_program(ns->nor, sector + in_sector, src, n);
+        }
+        offset += n;
+        src += n;
+        size -= n;
+    }
+    return status;
+}
+
+static void nor_reset_counters(nor_sim_t* nor) {
+    nor->erases = 0;
+    nor->programs = 0;
+    nor->program_bytes = 0;
+    nor->busy_us = 0.0;
+}
+
+/* =============================================================================
+ * WORKLOADS
+ * =============================================================================
+ */
+
+typedef struct {
+    const char* name;
+    uint8_t* source;
+    uint8_t* target;
+    size_t size;
+} workload_t;
+
+typedef struct {
+    const char* name;
+    double density;             /* Fraction of bytes changed */
+    bool shifted;               /* Insert bytes near the start instead */
+} workload_kind_t;
+
+static const workload_kind_t workload_kinds[] = {
+    { "density-0.1%", 0.001, false },
+    { "density-1%",   0.01,  false },
+    { "density-10%",  0.10,  false },
+    { "shifted-insert", 0.0, true  },
+};
+
+static const size_t workload_sizes[] = {
+    1024, 64 * 1024, 1024 * 1024, 4 * 1024 * 1024,
+    64 * 1024 * 1024, 256 * 1024 * 1024
+};
+
+/* Fixed-seed xorshift64 so every run sees identical data */
+static uint64_t bench_rand(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static void fill_random(uint8_t* data, size_t size, uint64_t* state) {
+    for (size_t i = 0; i < size; i++) {
+        data[i] = (uint8_t)bench_rand(state);
+    }
+}
+
+static bool workload_generate(workload_t* w, const workload_kind_t* kind, size_t size) {
+    uint64_t seed = 0x9E3779B97F4A7C15ull ^ (uint64_t)size;
+
+    w->name = kind->name;
+    w->size = size;
+    w->source = (uint8_t*)malloc(size);
+    w->target = (uint8_t*)malloc(size);
+    if (!w->source || !w->target) {
+        free(w->source);
+        free(w->target);
+        return false;
+    }
+
+    fill_random(w->source, size, &seed);
+
+    if (kind->shifted) {
+        /* 16 bytes inserted at 1% into the image, tail truncated */
+        size_t at = size / 100;
+        size_t insert = size > 32 ? 16 : 1;
+        memcpy(w->target, w->source, at);
+        fill_random(w->target + at, insert, &seed);
+        memcpy(w->target + at + insert, w->source + at, size - at - insert);
+    } else {
+        /* Changes clustered in 64-byte runs, as in recompiled firmware */
+        size_t changed = (size_t)((double)size * kind->density);
+        memcpy(w->target, w->source, size);
+        while (changed > 0) {
+            size_t run = changed < 64 ? changed : 64;
+            size_t at = (size_t)(bench_rand(&seed) % (size - run + 1));
+            fill_random(w->target + at, run, &seed);
+            changed -= run;
+        }
+    }
+    return true;
+}
+
+static bool workload_load_pair(workload_t* w, const char* old_path, const char* new_path) {
+    FILE* f_old = fopen(old_path, "rb");
+    FILE* f_new = fopen(new_path, "rb");
+    long old_size = -1, new_size = -1;
+
+    memset(w, 0, sizeof(*w));
+    if (f_old && f_new && fseek(f_old, 0, SEEK_END) == 0 && fseek(f_new, 0, SEEK_END) == 0) {
+        old_size = ftell(f_old);
+        new_size = ftell(f_new);
+        rewind(f_old);
+        rewind(f_new);
+    }
+
+    /* Positional XOR needs equal sizes; pad the shorter image with 0xFF */
+    if (old_size > 0 && new_size > 0) {
+        w->size = (size_t)(old_size > new_size ? old_size : new_size);
+        w->source = (uint8_t*)malloc(w->size);
+        w->target = (uint8_t*)malloc(w->size);
+    }
+    if (w->source && w->target) {
+        memset(w->source, 0xFF, w->size);
+        memset(w->target, 0xFF, w->size);
+        if (fread(w->source, 1, (size_t)old_size, f_old) != (size_t)old_size ||
+            fread(w->target, 1, (size_t)new_size, f_new) != (size_t)new_size) {
+            w->size = 0;
+        }
+    }
+
+    if (f_old) fclose(f_old);
+    if (f_new) fclose(f_new);
+
+    if (!w->source || !w->target || w->size == 0) {
+        fprintf(stderr, "xor_diff_bench: cannot load pair %s %s\n", old_path, new_path);
+        free(w->source);
+        free(w->target);
+        return false;
+    }
+    w->name = new_path;
+    return true;
+}
+
+static void workload_free(workload_t* w) {
+    free(w->source);
+    free(w->target);
+    w->source = NULL;
+    w->target = NULL;
+}
+
+/* =============================================================================
+ * MEASUREMENT
+ * =============================================================================
+ */
+
+typedef struct {
+    bool flash_only;
+    const char* op_filter;
+    size_t max_size;
+    double min_time_s;
+} bench_options_t;
+
+typedef struct {
+    uint64_t iterations;
+    double seconds;
+    size_t patch_bytes;
+    const char* mode;           /* "memory" or "stream" for patch ops, or NULL */
+    const nor_sim_t* nor;       /* Flash counters for flash ops, or NULL */
+} bench_result_t;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static bool op_selected(const bench_options_t* opt, const char* op, bool is_flash) {
+    if (opt->flash_only && !is_flash) {
+        return false;
+    }
+    return !opt->op_filter || strcmp(opt->op_filter, op) == 0;
+}
+
+static void emit(const char* op, const workload_t* w, const bench_result_t* r,
+                 xor_diff_result_t status) {
+    double per_op = r->iterations ? r->seconds / (double)r->iterations : 0.0;
+
+    printf("{\"op\":\"%s\",\"workload\":\"%s\",\"size\":%zu,\"status\":\"%s\","
+           "\"iterations\":%llu,\"ns_per_op\":%.0f,\"mb_per_s\":%.2f",
+           op, w->name, w->size, xor_diff_error_string(status),
+           (unsigned long long)r->iterations, per_op * 1e9,
+           per_op > 0.0 ? (double)w->size / per_op / 1e6 : 0.0);
+    if (r->mode) {
+        printf(",\"mode\":\"%s\"", r->mode);
+    }
+    if (r->patch_bytes) {
+        printf(",\"patch_bytes\":%zu", r->patch_bytes);
+    }
+    if (r->nor) {
+        printf(",\"erases\":%llu,\"programs\":%llu,\"program_bytes\":%llu,"
+               "\"flash_busy_us\":%.0f",
+               (unsigned long long)r->nor->erases,
+               (unsigned long long)r->nor->programs,
+               (unsigned long long)r->nor->program_bytes,
+               r->nor->busy_us);
+    }
+    printf("}\n");
+    fflush(stdout);
+}
+
+/* =============================================================================
+ * STREAMED PATCHES
+ * =============================================================================
+ * Images above XOR_DIFF_MAX_PATCH_SIZE cannot be held as an in-memory
+ * xor_patch_t, so create/apply go through the xor_diff_stream_* API with the
+ * serialized patch captured in a growable buffer.
+ */
+
+#define BENCH_STREAM_CHUNK (1024 * 1024)
+
+typedef struct {
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+} bench_buffer_t;
+
+static xor_diff_result_t buffer_sink(const uint8_t* data, size_t size, void* user_data) {
+    bench_buffer_t* buf = (bench_buffer_t*)user_data;
+
+    if (buf->size + size > buf->capacity) {
+        size_t capacity = buf->capacity ? buf->capacity : 64 * 1024;
+        uint8_t* grown;
+        while (capacity < buf->size + size) {
+            capacity *= 2;
+        }
+        grown = (uint8_t*)realloc(buf->data, capacity);
+        if (!grown) {
+            return XOR_DIFF_ERROR_MEMORY_ALLOC;
+        }
+        buf->data = grown;
+        buf->capacity = capacity;
+    }
+    memcpy(buf->data + buf->size, data, size);
+    buf->size += size;
+    return XOR_DIFF_SUCCESS;
+}
+
+static xor_diff_result_t work_read(uint64_t offset, void* buffer, size_t size,
+                                   void* user_data) {
+    memcpy(buffer, (const uint8_t*)user_data + offset, size);
+    return XOR_DIFF_SUCCESS;
+}
+
+static xor_diff_result_t work_write(uint64_t offset, const void* data, size_t size,
+                                    void* user_data) {
+    memcpy((uint8_t*)user_data + offset, data, size);
+    return XOR_DIFF_SUCCESS;
+}
+
+static xor_diff_result_t stream_create(xor_diff_context_t* ctx, const workload_t* w,
+                                       bench_buffer_t* out) {
+    xor_diff_stream_t stream;
+    xor_diff_result_t status;
+
+    out->size = 0;
+    status = xor_diff_stream_begin(ctx, &stream, w->size, buffer_sink, out);
+    if (status != XOR_DIFF_SUCCESS) {
+        return status;
+    }
+    for (size_t at = 0; status == XOR_DIFF_SUCCESS && at < w->size; at += BENCH_STREAM_CHUNK) {
+        size_t chunk = w->size - at < BENCH_STREAM_CHUNK ? w->size - at : BENCH_STREAM_CHUNK;
+        status = xor_diff_stream_feed(&stream, w->source + at, w->target + at, chunk);
+    }
+    if (status != XOR_DIFF_SUCCESS) {
+        xor_diff_stream_abort(&stream);
+        return status;
+    }
+    return xor_diff_stream_finish(&stream, NULL);
+}
+
+static xor_diff_result_t stream_apply(xor_diff_context_t* ctx, const bench_buffer_t* patch,
+                                      uint8_t* work) {
+    xor_diff_stream_t stream;
+    xor_diff_result_t status;
+
+    status = xor_diff_stream_apply_begin(ctx, &stream, work_read, work_write, work);
+    if (status != XOR_DIFF_SUCCESS) {
+        return status;
+    }
+    for (size_t at = 0; status == XOR_DIFF_SUCCESS && at < patch->size; at += BENCH_STREAM_CHUNK) {
+        size_t chunk = patch->size - at < BENCH_STREAM_CHUNK ? patch->size - at : BENCH_STREAM_CHUNK;
+        status = xor_diff_stream_apply_feed(&stream, patch->data + at, chunk);
+    }
+    if (status != XOR_DIFF_SUCCESS) {
+        xor_diff_stream_abort(&stream);
+        return status;
+    }
+    return xor_diff_stream_apply_finish(&stream);
+}
+
+static xor_diff_result_t stream_flash_apply(xor_diff_context_t* ctx,
+                                            const bench_buffer_t* patch,
+                                            nor_stream_t* ns) {
+    xor_diff_stream_t stream;
+    xor_diff_result_t status;
+
+    status = xor_diff_stream_apply_begin(ctx, &stream, nor_stream_read, nor_stream_write, ns);
+    if (status != XOR_DIFF_SUCCESS) {
+        return status;
+    }
+    for (size_t at = 0; status == XOR_DIFF_SUCCESS && at < patch->size; at += BENCH_STREAM_CHUNK) {
+        size_t chunk = patch->size - at < BENCH_STREAM_CHUNK ? patch->size - at : BENCH_STREAM_CHUNK;
+        status = xor_diff_stream_apply_feed(&stream, patch->data + at, chunk);
+    }
+    if (status != XOR_DIFF_SUCCESS) {
+        xor_diff_stream_abort(&stream);
+        return status;
+    }
+    return xor_diff_stream_apply_finish(&stream);
+}
+
+/* =============================================================================
+ * WORKLOAD DRIVER
+ * =============================================================================
+ */
+
+static void bench_workload(const bench_options_t* opt, xor_diff_context_t* ctx,
+                           const workload_t* w) {
+    uint8_t* work = (uint8_t*)malloc(w->size);
+    uint8_t* other = (uint8_t*)malloc(w->size);
+    xor_patch_t* patch = xor_patch_alloc(0);
+    bench_buffer_t streamed = { NULL, 0, 0 };
+    bool use_stream = w->size > XOR_DIFF_MAX_PATCH_SIZE;
+    bench_result_t r;
+    xor_diff_result_t status;
+    double start;
+
+    if (!work || !other || !patch) {
+        fprintf(stderr, "xor_diff_bench: out of memory at %zu bytes\n", w->size);
+        goto out;
+    }
+
+    /* Patch-independent ops first, so they report even if patching fails */
+    if (op_selected(opt, "swap", false)) {
+        memset(&r, 0, sizeof(r));
+        memcpy(work, w->source, w->size);
+        memcpy(other, w->target, w->size);
+        status = XOR_DIFF_SUCCESS;
+        start = now_seconds();
+        do {
+            status = xor_swap_blocks(ctx, work, other, w->size);
+            r.iterations++;
+            r.seconds = now_seconds() - start;
+        } while (status == XOR_DIFF_SUCCESS && r.seconds < opt->min_time_s);
+        emit("swap", w, &r, status);
+    }
+
+    if (op_selected(opt, "crc", false)) {
+        volatile uint32_t sink = 0;
+        memset(&r, 0, sizeof(r));
+        status = XOR_DIFF_SUCCESS;
+        start = now_seconds();
+        do {
+            sink ^= xor_diff_crc32(w->source, w->size);
+            r.iterations++;
+            r.seconds = now_seconds() - start;
+        } while (r.seconds < opt->min_time_s);
+        (void)sink;
+        emit("crc", w, &r, status);
+    }
+
+    /* Reference patch for apply, compress and flash ops */
+    if (use_stream) {
+        status = stream_create(ctx, w, &streamed);
+    } else {
+        status = xor_diff_create_patch(ctx, w->source, w->target, w->size, patch);
+    }
+    if (status != XOR_DIFF_SUCCESS) {
+        memset(&r, 0, sizeof(r));
+        r.mode = use_stream ? "stream" : "memory";
+        emit("create", w, &r, status);
+        goto out;
+    }
+
+    if (op_selected(opt, "create", false)) {
+        memset(&r, 0, sizeof(r));
+        r.mode = use_stream ? "stream" : "memory";
+        start = now_seconds();
+        do {
+            if (use_stream) {
+                status = stream_create(ctx, w, &streamed);
+            } else {
+                status = xor_diff_create_patch(ctx, w->source, w->target, w->size, patch);
+            }
+            r.iterations++;
+            r.seconds = now_seconds() - start;
+        } while (status == XOR_DIFF_SUCCESS && r.seconds < opt->min_time_s);
+        r.patch_bytes = use_stream ? streamed.size : patch->header.patch_size;
+        emit("create", w, &r, status);
+    }
+
+    if (op_selected(opt, "apply", false)) {
+        memset(&r, 0, sizeof(r));
+        r.mode = use_stream ? "stream" : "memory";
+        memcpy(work, w->source, w->size);
+        start = now_seconds();
+        do {
+            /* XOR patches are self-inverse, so alternating keeps work valid */
+            if (use_stream) {
+                status = stream_apply(ctx, &streamed, work);
+            } else {
+                status = xor_diff_apply_patch(ctx, patch, work);
+            }
+            r.iterations++;
+            r.seconds = now_seconds() - start;
+        } while (status == XOR_DIFF_SUCCESS && r.seconds < opt->min_time_s);
+        emit("apply", w, &r, status);
+    }
+
+    /* Compression operates on in-memory patches only */
+    if (use_stream && op_selected(opt, "compress", false)) {
+        memset(&r, 0, sizeof(r));
+        r.mode = "stream";
+        emit("compress", w, &r, XOR_DIFF_ERROR_UNSUPPORTED);
+    } else if (op_selected(opt, "compress", false)) {
+        memset(&r, 0, sizeof(r));
+        r.mode = "memory";
+        do {
+            status = xor_diff_create_patch(ctx, w->source, w->target, w->size, patch);
+            if (status != XOR_DIFF_SUCCESS) {
+                break;
+            }
+            start = now_seconds();
+            status = xor_patch_compress(patch);
+            r.seconds += now_seconds() - start;
+            r.iterations++;
+        } while (status == XOR_DIFF_SUCCESS && r.seconds < opt->min_time_s);
+        r.patch_bytes = patch->header.patch_size;
+        emit("compress", w, &r, status);
+
+        /* Restore the uncompressed reference patch */
+        status = xor_diff_create_patch(ctx, w->source, w->target, w->size, patch);
+        if (status != XOR_DIFF_SUCCESS) {
+            goto out;
+        }
+    }
+
+    /* Images must be whole sectors; report the skip instead of dropping it */
+    if (op_selected(opt, "flash-apply", true) && w->size % NOR_SECTOR_SIZE != 0) {
+        memset(&r, 0, sizeof(r));
+        r.mode = use_stream ? "stream" : "memory";
+        emit("flash-apply", w, &r, XOR_DIFF_ERROR_INVALID_SIZE);
+    } else if (op_selected(opt, "flash-apply", true)) {
+        static nor_stream_t ns;     /* Sector copy kept off the stack */
+        nor_sim_t nor;
+        memset(&nor, 0, sizeof(nor));
+        nor.mem = work;
+        nor.size = w->size;
+        ns.nor = &nor;
+        xor_diff_set_flash_callbacks(ctx, nor_write, nor_erase, &nor);
+
+        memset(&r, 0, sizeof(r));
+        r.mode = use_stream ? "stream" : "memory";
+        r.nor = &nor;
+        do {
+            memcpy(work, w->source, w->size);
+            nor_reset_counters(&nor);
+            start = now_seconds();
+            if (use_stream) {
+                /* Streamed patches go through the read/write-back path */
+                status = stream_flash_apply(ctx, &streamed, &ns);
+            } else {
+                status = xor_diff_flash_apply(ctx, patch, work, NOR_SECTOR_SIZE);
+            }
+            r.seconds += now_seconds() - start;
+            r.iterations++;
+        } while (status == XOR_DIFF_SUCCESS && r.seconds < opt->min_time_s);
+
+        if (status == XOR_DIFF_SUCCESS && memcmp(work, w->target, w->size) != 0) {
+            status = XOR_DIFF_ERROR_CHECKSUM_MISMATCH;
+        }
+        emit("flash-apply", w, &r, status);
+        xor_diff_set_flash_callbacks(ctx, NULL, NULL, NULL);
+    }
+
+out:
+    if (patch) xor_patch_free(patch);
+    free(streamed.data);
+    free(work);
+    free(other);
+}
+
+/* =============================================================================
+ * MAIN
+ * =============================================================================
+ */
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: xor_diff_bench [--flash] [--op swap|create|apply|crc|compress|flash-apply]\n"
+            "                      [--max-size BYTES] [--min-time-ms MS]\n"
+            "                      [--pair OLD.bin NEW.bin]...\n");
+}
+
+int main(int argc, char** argv) {
+    bench_options_t opt;
+    xor_diff_context_t ctx;
+    xor_diff_config_t config = xor_diff_default_config();
+    int pairs = 0;
+
+    opt.flash_only = false;
+    opt.op_filter = NULL;
+    opt.max_size = 256u * 1024 * 1024;
+    opt.min_time_s = 0.2;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--flash") == 0) {
+            opt.flash_only = true;
+        } else if (strcmp(argv[i], "--op") == 0 && i + 1 < argc) {
+            opt.op_filter = argv[++i];
+        } else if (strcmp(argv[i], "--max-size") == 0 && i + 1 < argc) {
+            opt.max_size = (size_t)strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--min-time-ms") == 0 && i + 1 < argc) {
+            opt.min_time_s = strtod(argv[++i], NULL) / 1000.0;
+        } else if (strcmp(argv[i], "--pair") == 0 && i + 2 < argc) {
+            i += 2;
+            pairs++;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+
+    config.flash_elide_writes = true;
+    config.flash_sector_size = NOR_SECTOR_SIZE;
+    config.flash_page_size = NOR_PAGE_SIZE;
+    if (xor_diff_init(&ctx, &config) != XOR_DIFF_SUCCESS) {
+        fprintf(stderr, "xor_diff_bench: xor_diff_init failed\n");
+        return 1;
+    }
+
+    for (size_t k = 0; k < sizeof(workload_kinds) / sizeof(workload_kinds[0]); k++) {
+        for (size_t s = 0; s < sizeof(workload_sizes) / sizeof(workload_sizes[0]); s++) {
+            workload_t w;
+            if (workload_sizes[s] > opt.max_size) {
+                continue;
+            }
+            if (!workload_generate(&w, &workload_kinds[k], workload_sizes[s])) {
+                fprintf(stderr, "xor_diff_bench: out of memory at %zu bytes\n",
+                        workload_sizes[s]);
+                continue;
+            }
+            bench_workload(&opt, &ctx, &w);
+            workload_free(&w);
+        }
+    }
+
+    for (int i = 1; pairs > 0 && i < argc; i++) {
+        if (strcmp(argv[i], "--pair") == 0) {
+            workload_t w;
+            if (workload_load_pair(&w, argv[i + 1], argv[i + 2])) {
+                bench_workload(&opt, &ctx, &w);
+                workload_free(&w);
+            }
+            i += 2;
+        }
+    }
+
+    xor_diff_cleanup(&ctx);
+    return 0;
+}
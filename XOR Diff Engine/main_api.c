@@ -33,7 +33,10 @@ typedef enum {
     XOR_DIFF_ERROR_FLASH_WRITE = -4,
     XOR_DIFF_ERROR_CHECKSUM_MISMATCH = -5,
     XOR_DIFF_ERROR_VERSION_MISMATCH = -6,
-    XOR_DIFF_ERROR_PATCH_CORRUPT = -7
+    XOR_DIFF_ERROR_PATCH_CORRUPT = -7,
+    XOR_DIFF_ERROR_UNSUPPORTED = -8,
+    XOR_DIFF_ERROR_IO = -9,
+    XOR_DIFF_ERROR_MISALIGNED = -10
 } xor_diff_result_t;
 
 /* Patch metadata structure */
@@ -48,19 +51,209 @@ typedef struct {
     uint16_t reserved;          /* Reserved for future use */
 } xor_patch_header_t;
 
-/* Patch structure */
+/* Patch header flags */
+#define XOR_PATCH_FLAG_SPARSE   0x01u   /* patch_data is a list of runs */
+#define XOR_PATCH_FLAG_STREAMED 0x02u   /* Sizes/checksums in trailing header */
+#define XOR_PATCH_FLAG_CHUNKED  0x04u   /* patch_data is a sequence of chunks */
+#define XOR_PATCH_FLAG_CDC      0x08u   /* patch_data is a COPY/XOR/LITERAL op list */
+#define XOR_PATCH_FLAG_SEGMENTED 0x80u  /* Priority-ordered segments */
+#define XOR_PATCH_FLAG_CODEC_MASK  0x70u /* Compression codec id, bits 4-6 */
+#define XOR_PATCH_FLAG_CODEC_SHIFT 4
+
+#define XOR_PATCH_GET_CODEC(flags) \
+    ((uint8_t)(((flags) & XOR_PATCH_FLAG_CODEC_MASK) >> XOR_PATCH_FLAG_CODEC_SHIFT))
+
+/* Compression codecs; ids 5-7 are free for xor_diff_register_codec */
+typedef enum {
+    XOR_PATCH_CODEC_NONE = 0,
+    XOR_PATCH_CODEC_RLE = 1,        /* Zero-run RLE (built in) */
+    XOR_PATCH_CODEC_LZ4 = 2,        /* LZ4-class fast codec (built in) */
+    XOR_PATCH_CODEC_HEATSHRINK = 3, /* LZSS, tiny RAM for MCUs (built in) */
+    XOR_PATCH_CODEC_ZSTD = 4        /* Reserved, register when linked */
+} xor_patch_codec_t;
+
+/* Sparse patch run, followed in patch_data by `length` XOR delta bytes.
+ * Runs are stored in ascending offset order and never overlap; bytes not
+ * covered by any run are unchanged. Fields are stored little-endian. */
+typedef struct {
+    uint32_t offset;            /* Offset of the run in the data */
+    uint32_t length;            /* Number of XOR delta bytes that follow */
+} xor_patch_run_t;
+
+/* Allocator hooks for patch buffers (e.g. a per-thread pool) */
+typedef struct {
+    void* (*alloc)(size_t size, void* user_data);
+    void (*free)(void* ptr, size_t size, void* user_data);
+    void* user_data;
+} xor_diff_allocator_t;
+
+/* Patch structure. APIs that fill in a caller's patch reuse and grow
+ * patch_data through allocator, so a patch passed to them must hold a
+ * valid state: from xor_patch_alloc*, XOR_PATCH_INIT, xor_patch_init or
+ * an earlier fill. An uninitialized stack patch is undefined behaviour.
+ * Release caller-owned structs with xor_patch_release and patches from
+ * xor_patch_alloc* with xor_patch_free. */
 typedef struct {
     xor_patch_header_t header;
-    uint8_t* patch_data;        /* XOR delta data */
+    uint8_t* patch_data;        /* XOR delta data, dense or sparse runs */
+    size_t capacity;            /* Bytes allocated behind patch_data */
+    const xor_diff_allocator_t* allocator; /* NULL = malloc/free */
 } xor_patch_t;
 
-/* Configuration structure */
+/* Empty patch (no buffer, malloc/free), e.g. xor_patch_t p = XOR_PATCH_INIT; */
+#define XOR_PATCH_INIT { { 0, 0, 0, 0, 0, 0, 0, 0 }, NULL, 0, NULL }
+
+/* On-wire patch header, format version 1. Fixed-width little-endian
+ * fields, naturally aligned so the layout is identical on 32- and 64-bit
+ * targets and can be read in place from an 8-byte aligned buffer.
+ * Serialized patches are this header followed by patch_size bytes of
+ * patch_data. */
+#define XOR_PATCH_WIRE_MAGIC     0x46504458u /* "XDPF" */
+#define XOR_PATCH_FORMAT_VERSION 1u
+
+typedef struct {
+    uint32_t magic;             /* XOR_PATCH_WIRE_MAGIC */
+    uint16_t format_version;    /* XOR_PATCH_FORMAT_VERSION */
+    uint16_t header_size;       /* sizeof(xor_patch_wire_header_t) */
+    uint32_t version;           /* Patch version */
+    uint32_t source_checksum;   /* CRC32 of source data */
+    uint32_t target_checksum;   /* CRC32 of target data */
+    uint32_t header_checksum;   /* CRC32 of this header, field taken as 0 */
+    uint64_t data_size;         /* Size of original data */
+    uint64_t patch_size;        /* Size of patch data */
+    uint8_t compression_level;
+    uint8_t flags;              /* XOR_PATCH_FLAG_* */
+    uint8_t reserved[6];        /* Must be zero */
+} xor_patch_wire_header_t;
+
+typedef char xor_patch_wire_header_size_check[
+    (sizeof(xor_patch_wire_header_t) == 48) ? 1 : -1];
+
+/* Streamed patch layout (XOR_PATCH_FLAG_STREAMED):
+ *   wire header     flags = STREAMED | SPARSE, codec bits 0, data_size,
+ *                   patch_size and both checksums 0 (not yet known)
+ *   body            xor_patch_run_t + payload records, ascending offset
+ *   end marker      xor_patch_run_t { XOR_PATCH_RUN_END, 0 }
+ *   trailer         xor_patch_stream_trailer_t
+ * Streamed bodies are uncompressed sparse runs, so run offsets limit a
+ * streamed image to 4 GiB. All fields are little-endian. */
+#define XOR_PATCH_RUN_END           0xFFFFFFFFu /* Offset of the end marker */
+#define XOR_PATCH_TRAILER_MAGIC     0x54504458u /* "XDPT" */
+
+typedef struct {
+    uint32_t magic;             /* XOR_PATCH_TRAILER_MAGIC */
+    uint32_t source_checksum;   /* CRC32 of source data */
+    uint32_t target_checksum;   /* CRC32 of target data */
+    uint32_t trailer_checksum;  /* CRC32 of this trailer, field taken as 0 */
+    uint64_t data_size;         /* Size of original data */
+    uint64_t patch_size;        /* Body bytes, end marker included */
+} xor_patch_stream_trailer_t;
+
+typedef char xor_patch_stream_trailer_size_check[
+    (sizeof(xor_patch_stream_trailer_t) == 32) ? 1 : -1];
+
+/* Borrowed, read-only patch view into a serialized buffer (no copy) */
+typedef struct {
+    const xor_patch_wire_header_t* wire; /* In place; buffer 8-byte aligned */
+    xor_patch_header_t header;  /* Decoded header */
+    const uint8_t* patch_data;  /* Points into the serialized buffer */
+} xor_patch_view_t;
+
+/* Instruction set used by the XOR kernels */
+typedef enum {
+    XOR_DIFF_ISA_AUTO = 0,      /* Pick the best available at init time */
+    XOR_DIFF_ISA_SCALAR,        /* Portable 64-bit word loop */
+    XOR_DIFF_ISA_SSE2,
+    XOR_DIFF_ISA_AVX2,
+    XOR_DIFF_ISA_AVX512,
+    XOR_DIFF_ISA_NEON
+} xor_diff_isa_t;
+
+/* Kernel dispatch table. All kernels accept unaligned pointers and any size;
+ * buffers passed to one call must not overlap. */
+typedef struct {
+    xor_diff_isa_t isa;
+    /* dest ^= src */
+    void (*xor_into)(uint8_t* dest, const uint8_t* src, size_t size);
+    /* dest = a ^ b */
+    void (*xor_pair)(uint8_t* dest, const uint8_t* a, const uint8_t* b, size_t size);
+    /* Exchange a and b via XOR */
+    void (*xor_swap)(uint8_t* a, uint8_t* b, size_t size);
+    /* Exchange a and b, register-blocked: each line loaded and stored once */
+    void (*swap)(uint8_t* a, uint8_t* b, size_t size);
+    /* Offset of first non-zero byte, or size if all zero */
+    size_t (*find_nonzero)(const uint8_t* data, size_t size);
+    /* Offset of first differing byte, or size if equal */
+    size_t (*compare)(const uint8_t* a, const uint8_t* b, size_t size);
+    /* CRC32 update: ARMv8 CRC32 or PCLMULQDQ folding, else slicing-by-8 */
+    uint32_t (*crc32_update)(uint32_t state, const uint8_t* data, size_t size);
+    /* Fused dest = src ^ tgt with both CRC states updated in the same pass;
+     * returns true if any delta byte is non-zero */
+    bool (*diff_crc)(uint8_t* dest, const uint8_t* src, const uint8_t* tgt,
+                     size_t size, uint32_t* src_crc, uint32_t* tgt_crc);
+} xor_diff_kernels_t;
+
+/* Codec implementation. Decoding is incremental with a fixed
+ * decoder_state_size, so decompression streams in bounded memory. */
 typedef struct {
-    size_t block_size;          /* Processing block size (default: 4096) */
-    bool enable_compression;    /* Enable RLE compression */
+    uint8_t id;                 /* xor_patch_codec_t or 5-7 */
+    const char* name;
+    size_t decoder_state_size;  /* Caller-provided decoder state bytes */
+    size_t (*max_compressed_size)(size_t input_size);
+    xor_diff_result_t (*compress)(const uint8_t* input, size_t input_size,
+                                  uint8_t* output, size_t output_capacity,
+                                  size_t* output_size, uint8_t level);
+    xor_diff_result_t (*decode_init)(void* state, uint8_t level);
+    xor_diff_result_t (*decode_feed)(void* state,
+                                     const uint8_t* input, size_t input_size,
+                                     size_t* input_consumed,
+                                     uint8_t* output, size_t output_capacity,
+                                     size_t* output_produced);
+} xor_patch_codec_ops_t;
+
+/* One unit of parallel work; tasks within a batch are independent */
+typedef xor_diff_result_t (*xor_task_fn)(size_t task_index, void* task_arg);
+
+/* Task executor: runs task(i, task_arg) for every i in [0, task_count),
+ * possibly concurrently, and returns once all have finished with the
+ * first non-success result (or XOR_DIFF_SUCCESS). */
+typedef xor_diff_result_t (*xor_task_executor_fn)(xor_task_fn task,
+                                                  void* task_arg,
+                                                  size_t task_count,
+                                                  void* user_data);
+
+/* Configuration structure. Start from xor_diff_default_config() and
+ * override fields; a zeroed or partially designated-initialized struct
+ * is not a valid configuration. Only the fields marked "0 = default"
+ * map zero to their default; every other field is taken as given, in
+ * particular flash_erased_value, where 0x00 is a real erased value. */
+typedef struct {
+    size_t block_size;          /* Processing block size (0 = default: 4096) */
+    bool enable_compression;    /* Compress patches with `codec` */
     bool enable_checksum;       /* Enable integrity checking */
     bool flash_optimized;       /* Use flash-friendly write patterns */
-    uint8_t write_alignment;    /* Flash write alignment (1, 2, 4, 8) */
+    uint8_t write_alignment;    /* Flash write alignment (1, 2, 4, 8; 0 = 1) */
+    bool enable_sparse;         /* Emit sparse run-based patches */
+    size_t sparse_merge_gap;    /* Unchanged bytes merged into a run (default: 8) */
+    xor_diff_isa_t isa;         /* Kernel instruction set (default: AUTO) */
+    bool single_pass;           /* Fused diff/CRC/encode in one pass per block */
+    uint32_t thread_count;      /* Worker threads, 0 or 1 = serial */
+    xor_task_executor_fn executor; /* Custom executor (RTOS), overrides pool */
+    void* executor_user_data;
+    uint8_t codec;              /* xor_patch_codec_t (default: RLE) */
+    uint8_t compression_level;  /* Codec level 0-9, stored in the header */
+    bool flash_elide_writes;    /* Skip sectors/erases the delta does not need */
+    uint8_t flash_erased_value; /* Erased byte value (default: 0xFF, NOR) */
+    size_t flash_sector_size;   /* Erase unit for batch apply (0 = default: 4096) */
+    size_t flash_page_size;     /* Program burst limit (0 = default: 256) */
+    bool flash_allow_reorder;   /* Sectors may be written out of address order */
+    uint8_t flash_pipeline_depth; /* Sectors staged in flight (0 = default: 2) */
+    void* arena;                /* Caller-provided scratch memory, or NULL */
+    size_t arena_size;          /* >= xor_diff_arena_required() */
+    size_t cdc_min_chunk;       /* Content-defined chunk bounds */
+    size_t cdc_avg_chunk;       /* (0 = defaults: 2048 / 8192 / 65536) */
+    size_t cdc_max_chunk;
+    bool cdc_inplace;           /* Restrict ops so apply can run in place */
 } xor_diff_config_t;
 
 /* Context structure for stateful operations */
@@ -69,6 +262,7 @@ typedef struct xor_diff_context {
     uint32_t current_version;
     size_t total_operations;
     uint64_t bytes_processed;
+    const xor_diff_kernels_t* kernels; /* Selected at xor_diff_init */
     void* internal_state;       /* Internal implementation state */
 } xor_diff_context_t;
 
@@ -77,48 +271,88 @@ typedef struct xor_diff_context {
  * =============================================================================
  */
 
-/* Initialize XOR diff engine context */
+/* Initialize XOR diff engine context. Selects the kernel table for
+ * config.isa; returns XOR_DIFF_ERROR_UNSUPPORTED if a forced ISA is not
+ * available on this CPU.
+ * With config.thread_count > 1 (and no executor) a worker pool is started.
+ * Create, apply, swap, CRC and compare are then split into block_size
+ * tasks whose results are merged in block order, so output is identical
+ * to a serial run.
+ * With config.arena set, the fixed-size working buffers are carved from
+ * it here: flash sector staging (flash_pipeline_depth sectors), the
+ * stream block buffer, codec decoder state, the journal/slot-swap sector
+ * buffer and the chunk reader buffer. The flash apply, journaled, async,
+ * chunked, batch apply, flash update and streaming paths then never
+ * allocate; XOR_DIFF_ERROR_MEMORY_ALLOC if arena_size is too small.
+ * Buffers whose size depends on each call are not in the arena: see
+ * XOR_DIFF_NO_HEAP for the APIs that allocate them. */
 xor_diff_result_t xor_diff_init(xor_diff_context_t* ctx, 
                                 const xor_diff_config_t* config);
 
-/* Cleanup XOR diff engine context */
+/* Cleanup XOR diff engine context (also releases an acquired context) */
 void xor_diff_cleanup(xor_diff_context_t* ctx);
 
 /* Create default configuration */
 xor_diff_config_t xor_diff_default_config(void);
 
+/* Minimum arena_size for a configuration (block_size, sector/page sizes,
+ * pipeline depth, codec decoder state). Covers only the fixed-size
+ * buffers listed at xor_diff_init. */
+size_t xor_diff_arena_required(const xor_diff_config_t* config);
+
+/* Best instruction set supported by the running CPU */
+xor_diff_isa_t xor_diff_detect_isa(void);
+
+/* Kernel table for an ISA (AUTO = detected), or NULL if not supported */
+const xor_diff_kernels_t* xor_diff_get_kernels(xor_diff_isa_t isa);
+
 /* =============================================================================
  * IN-PLACE XOR SWAP OPERATIONS
  * =============================================================================
  */
 
-/* Perform in-place XOR swap between two memory regions */
+/* Perform in-place XOR swap between two memory regions. Non-overlapping
+ * regions go through the single-pass swap kernel; identical pointers are
+ * left unchanged instead of being zeroed. */
 xor_diff_result_t xor_swap_inplace(void* data_a, void* data_b, size_t size);
 
 /* Perform in-place XOR swap with context (for tracking/logging) */
 xor_diff_result_t xor_swap_inplace_ctx(xor_diff_context_t* ctx,
                                        void* data_a, void* data_b, size_t size);
 
-/* Triple XOR swap (classic algorithm) */
+/* Triple XOR swap (classic algorithm, three passes over each buffer) */
 xor_diff_result_t xor_swap_triple(void* data_a, void* data_b, size_t size);
 
-/* Block-wise XOR swap for large data */
+/* Block-wise XOR swap for large data using the context's kernels */
 xor_diff_result_t xor_swap_blocks(xor_diff_context_t* ctx,
                                   void* data_a, void* data_b, size_t size);
 
+/* Single-pass swap of two non-overlapping regions with the detected SIMD
+ * swap kernel; reads and writes each buffer once */
+xor_diff_result_t xor_swap_fast(void* data_a, void* data_b, size_t size);
+
 /* =============================================================================
  * XOR DELTA PATCH OPERATIONS
  * =============================================================================
  */
 
-/* Generate XOR delta patch between source and target */
+/* Generate XOR delta patch between source and target. patch must be
+ * initialized (see xor_patch_t); its buffer is reused.
+ * With config.enable_sparse set, only the changed runs are stored and
+ * XOR_PATCH_FLAG_SPARSE is set in the header. An existing patch_data is
+ * reused when its capacity suffices and grown through the patch's
+ * allocator otherwise.
+ * With config.single_pass set, source and target are read once per
+ * block_size block: both header CRCs are updated, all-zero blocks are
+ * skipped and the sparse/RLE output is emitted in that same pass, so no
+ * separate xor_patch_compress call is needed. */
 xor_diff_result_t xor_diff_create_patch(xor_diff_context_t* ctx,
                                         const void* source_data,
                                         const void* target_data,
                                         size_t data_size,
                                         xor_patch_t* patch);
 
-/* Apply XOR delta patch to source data */
+/* Apply XOR delta patch to source data (dense or sparse, in-place) */
 xor_diff_result_t xor_diff_apply_patch(xor_diff_context_t* ctx,
                                        const xor_patch_t* patch,
                                        void* source_data);
@@ -129,35 +363,665 @@ xor_diff_result_t xor_diff_apply_patch_safe(xor_diff_context_t* ctx,
                                             void* source_data,
                                             bool verify_checksum);
 
-/* Generate reverse patch for rollback */
+/* Apply a borrowed patch view; same semantics as xor_diff_apply_patch */
+xor_diff_result_t xor_diff_apply_patch_view(xor_diff_context_t* ctx,
+                                            const xor_patch_view_t* view,
+                                            void* source_data);
+
+/* Generate reverse patch for rollback into an initialized reverse_patch */
 xor_diff_result_t xor_diff_create_reverse_patch(const xor_patch_t* forward_patch,
                                                 xor_patch_t* reverse_patch);
 
+/* =============================================================================
+ * BLOCK FINGERPRINT INDEX
+ * =============================================================================
+ * One 64-bit fingerprint per block_size block, built once per baseline.
+ * Diffs against the baseline compare fingerprints first and read the
+ * source only for blocks that changed. The in-memory struct is not a
+ * storage format; persist it with xor_block_index_serialize, which writes
+ * an xor_block_index_wire_header_t followed by block_count little-endian
+ * uint64_t fingerprints. hash_id identifies the fingerprint function.
+ */
+
+#define XOR_BLOCK_HASH_ID 1u
+
+typedef struct {
+    size_t block_size;
+    size_t block_count;
+    uint64_t data_size;
+    uint32_t hash_id;           /* XOR_BLOCK_HASH_ID when built */
+    uint32_t data_checksum;     /* CRC32 of the indexed data */
+    uint64_t* fingerprints;     /* block_count entries */
+} xor_block_index_t;
+
+/* Stable 64-bit block fingerprint used by the index */
+uint64_t xor_diff_block_hash(const void* data, size_t size);
+
+/* Fingerprint data in config.block_size blocks */
+xor_diff_result_t xor_block_index_build(xor_diff_context_t* ctx,
+                                        const void* data,
+                                        size_t data_size,
+                                        xor_block_index_t* index);
+
+/* Release fingerprints */
+void xor_block_index_free(xor_block_index_t* index);
+
+#define XOR_BLOCK_INDEX_MAGIC 0x49504458u /* "XDPI" */
+
+/* On-disk index header, format version 1; fixed-width little-endian */
+typedef struct {
+    uint32_t magic;             /* XOR_BLOCK_INDEX_MAGIC */
+    uint16_t format_version;    /* XOR_PATCH_FORMAT_VERSION */
+    uint16_t header_size;       /* sizeof(xor_block_index_wire_header_t) */
+    uint32_t hash_id;
+    uint32_t data_checksum;
+    uint32_t block_size;
+    uint32_t header_checksum;   /* CRC32 of this header, field taken as 0 */
+    uint64_t data_size;
+    uint64_t block_count;
+} xor_block_index_wire_header_t;
+
+typedef char xor_block_index_wire_header_size_check[
+    (sizeof(xor_block_index_wire_header_t) == 40) ? 1 : -1];
+
+/* Bytes needed by xor_block_index_serialize */
+size_t xor_block_index_serialized_size(const xor_block_index_t* index);
+
+/* Write the index in its on-disk format */
+xor_diff_result_t xor_block_index_serialize(const xor_block_index_t* index,
+                                            uint8_t* buffer,
+                                            size_t buffer_size,
+                                            size_t* bytes_written);
+
+/* Load a serialized index (fingerprints are copied). Returns
+ * XOR_DIFF_ERROR_PATCH_CORRUPT on bad magic, header checksum or length,
+ * and XOR_DIFF_ERROR_VERSION_MISMATCH on an unknown format or hash_id. */
+xor_diff_result_t xor_block_index_load(const uint8_t* buffer,
+                                       size_t buffer_size,
+                                       xor_block_index_t* index);
+
+/* First block whose fingerprints differ, or block_count if none */
+size_t xor_block_index_first_diff(const xor_block_index_t* index_a,
+                                  const xor_block_index_t* index_b);
+
+/* Create a patch against an indexed source into an initialized patch.
+ * Target blocks are hashed and the source is only read where the
+ * fingerprint differs; the header's source_checksum comes from the
+ * index. Returns
+ * XOR_DIFF_ERROR_INVALID_SIZE if the index does not match data_size or
+ * config.block_size. */
+xor_diff_result_t xor_diff_create_patch_indexed(xor_diff_context_t* ctx,
+                                                const xor_block_index_t* source_index,
+                                                const void* source_data,
+                                                const void* target_data,
+                                                size_t data_size,
+                                                xor_patch_t* patch);
+
+/* Create patches from one source to target_count targets in a single
+ * source pass: each source block is read once and diffed against every
+ * target, sharing the source CRC (and fingerprints when source_index is
+ * given, which may be NULL). Targets run in parallel when threads or an
+ * executor are configured. patches[i], each initialized, receives the
+ * patch for targets[i]; on failure every patches[i] is left released. */
+xor_diff_result_t xor_diff_create_patches_multi(xor_diff_context_t* ctx,
+                                                const void* source_data,
+                                                const void* const* targets,
+                                                size_t target_count,
+                                                size_t data_size,
+                                                const xor_block_index_t* source_index,
+                                                xor_patch_t* patches);
+
+/* =============================================================================
+ * SHIFT-TOLERANT (CONTENT-DEFINED CHUNKING) PATCHES
+ * =============================================================================
+ * Source and target are split at rolling-hash boundaries and chunks are
+ * matched by content, so inserted or removed bytes do not turn the rest of
+ * the image into delta. patch_data holds an xor_cdc_prologue_t followed by
+ * ops that produce the target in order; header.data_size is the target
+ * size. All fields are little-endian.
+ */
+
+typedef enum {
+    XOR_CDC_OP_COPY = 1,        /* Copy `length` bytes from src_offset */
+    XOR_CDC_OP_XOR = 2,         /* Source bytes at src_offset ^ payload */
+    XOR_CDC_OP_LITERAL = 3      /* `length` payload bytes */
+} xor_cdc_op_type_t;
+
+#define XOR_CDC_FLAG_INPLACE_SAFE 0x01u /* Ops never read overwritten data */
+
+typedef struct {
+    uint64_t source_size;
+    uint32_t flags;             /* XOR_CDC_FLAG_* */
+    uint32_t op_count;
+} xor_cdc_prologue_t;
+
+/* Op header; XOR and LITERAL ops are followed by `length` payload bytes */
+typedef struct {
+    uint8_t type;               /* xor_cdc_op_type_t */
+    uint8_t reserved[3];
+    uint32_t length;
+    uint64_t src_offset;        /* Unused for LITERAL */
+} xor_cdc_op_t;
+
+/* Create a shift-tolerant patch into an initialized patch; sizes may
+ * differ. Chunks whose position is unchanged are emitted as XOR ops to
+ * keep apply sector-friendly. With config.cdc_inplace, copies that would read bytes already overwritten
+ * are demoted to literals and XOR_CDC_FLAG_INPLACE_SAFE is set. */
+xor_diff_result_t xor_diff_create_patch_cdc(xor_diff_context_t* ctx,
+                                            const void* source_data,
+                                            size_t source_size,
+                                            const void* target_data,
+                                            size_t target_size,
+                                            xor_patch_t* patch);
+
+/* Apply a shift-tolerant patch. target_data may equal source_data only for
+ * XOR_CDC_FLAG_INPLACE_SAFE patches; target_capacity must hold data_size. */
+xor_diff_result_t xor_diff_apply_patch_cdc(xor_diff_context_t* ctx,
+                                           const xor_patch_t* patch,
+                                           const void* source_data,
+                                           size_t source_size,
+                                           void* target_data,
+                                           size_t target_capacity);
+
+/* =============================================================================
+ * STREAMING OPERATIONS
+ * =============================================================================
+ * Diff or patch inputs of any size with a working set of one block_size
+ * block. Streamed patches are not limited by XOR_DIFF_MAX_PATCH_SIZE.
+ * A successful begin must be paired with exactly one finish or abort:
+ * finish releases the stream buffers whatever it returns, and abort
+ * releases them after a failed feed (or to cancel) without emitting or
+ * checking anything.
+ */
+
+/* Receives serialized patch bytes as they are produced */
+typedef xor_diff_result_t (*xor_patch_sink_fn)(const uint8_t* data,
+                                               size_t size,
+                                               void* user_data);
+
+/* Reads/writes the data being patched at an absolute offset */
+typedef xor_diff_result_t (*xor_data_read_fn)(uint64_t offset,
+                                              void* buffer,
+                                              size_t size,
+                                              void* user_data);
+
+typedef xor_diff_result_t (*xor_data_write_fn)(uint64_t offset,
+                                               const void* data,
+                                               size_t size,
+                                               void* user_data);
+
+/* Streaming state; caller-allocated, fields are read-only */
+typedef struct {
+    xor_diff_context_t* ctx;
+    uint64_t total_size;        /* Expected data size, 0 if unknown */
+    uint64_t position;          /* Data bytes consumed so far */
+    uint32_t source_crc;        /* Running CRC32 state of source */
+    uint32_t target_crc;        /* Running CRC32 state of target */
+    void* internal_state;       /* Block buffer and encoder state */
+} xor_diff_stream_t;
+
+/* Start streaming patch creation. Output follows the streamed layout
+ * described with xor_patch_stream_trailer_t: the header is emitted first,
+ * runs as blocks are fed, and the end marker and trailer on finish. */
+xor_diff_result_t xor_diff_stream_begin(xor_diff_context_t* ctx,
+                                        xor_diff_stream_t* stream,
+                                        uint64_t total_size,
+                                        xor_patch_sink_fn sink,
+                                        void* user_data);
+
+/* Feed matching source/target chunks; chunk sizes are arbitrary */
+xor_diff_result_t xor_diff_stream_feed(xor_diff_stream_t* stream,
+                                       const void* source_chunk,
+                                       const void* target_chunk,
+                                       size_t chunk_size);
+
+/* Flush pending output, emit the trailer and release stream buffers.
+ * header (optional) receives the final patch header. The buffers are
+ * released even when an error is returned. */
+xor_diff_result_t xor_diff_stream_finish(xor_diff_stream_t* stream,
+                                         xor_patch_header_t* header);
+
+/* Release the buffers of a creation or apply stream without finishing it;
+ * the stream may then be reused with a new begin. Safe to call on a stream
+ * that has already been finished or aborted. */
+void xor_diff_stream_abort(xor_diff_stream_t* stream);
+
+/* Start streaming patch application. Each block is read through read_fn,
+ * XORed and written back at the same offset through write_fn. */
+xor_diff_result_t xor_diff_stream_apply_begin(xor_diff_context_t* ctx,
+                                              xor_diff_stream_t* stream,
+                                              xor_data_read_fn read_fn,
+                                              xor_data_write_fn write_fn,
+                                              void* user_data);
+
+/* Feed serialized patch bytes in any fragmentation. Accepts streamed
+ * patches and ordinary serialized sparse or dense patches. */
+xor_diff_result_t xor_diff_stream_apply_feed(xor_diff_stream_t* stream,
+                                             const uint8_t* patch_bytes,
+                                             size_t size);
+
+/* Check the end marker and trailer checksum (and the target CRC when
+ * enable_checksum is set); XOR_DIFF_ERROR_PATCH_CORRUPT if truncated.
+ * Releases the stream buffers whatever it returns. */
+xor_diff_result_t xor_diff_stream_apply_finish(xor_diff_stream_t* stream);
+
+/* =============================================================================
+ * FILE OPERATIONS (hosted POSIX builds)
+ * =============================================================================
+ * Inputs are mmap'ed with MADV_SEQUENTIAL and the serialized patch is
+ * written straight to the output file, so peak RSS does not grow with the
+ * image size. Failures of open/mmap/write return XOR_DIFF_ERROR_IO.
+ */
+
+/* Enabled by default on POSIX hosts; define XOR_DIFF_ENABLE_FILE_IO to
+ * force it on elsewhere or XOR_DIFF_DISABLE_FILE_IO to leave it out */
+#if !defined(XOR_DIFF_ENABLE_FILE_IO) && !defined(XOR_DIFF_DISABLE_FILE_IO) && \
+    (defined(__unix__) || defined(__APPLE__))
+#define XOR_DIFF_ENABLE_FILE_IO
+#endif
+
+#ifdef XOR_DIFF_DISABLE_FILE_IO
+#undef XOR_DIFF_ENABLE_FILE_IO
+#endif
+
+#ifdef XOR_DIFF_ENABLE_FILE_IO
+
+/* Diff two equally sized files and write the serialized patch to out_path */
+xor_diff_result_t xor_diff_create_patch_files(xor_diff_context_t* ctx,
+                                              const char* src_path,
+                                              const char* dst_path,
+                                              const char* out_path);
+
+/* Apply a serialized patch file to src_path, writing out_path.
+ * out_path may equal src_path to patch the file in place. */
+xor_diff_result_t xor_diff_apply_patch_files(xor_diff_context_t* ctx,
+                                             const char* src_path,
+                                             const char* patch_path,
+                                             const char* out_path);
+
+#endif /* XOR_DIFF_ENABLE_FILE_IO */
+
 /* =============================================================================
  * FLASH-OPTIMIZED OPERATIONS
  * =============================================================================
  */
 
-/* Flash-optimized patch application with minimal writes */
+/* What a sector needs for a given XOR delta */
+typedef enum {
+    XOR_FLASH_SECTOR_UNTOUCHED = 0, /* Delta is all zero */
+    XOR_FLASH_SECTOR_PROGRAM_ONLY,  /* Only moves bits away from erased value */
+    XOR_FLASH_SECTOR_NEEDS_ERASE    /* Some bit returns to the erased value */
+} xor_flash_sector_class_t;
+
+/* Classify a sector from its current contents and XOR delta. With erased
+ * value 0xFF a sector is program-only when (delta & ~current) == 0, i.e.
+ * the update only clears bits. */
+xor_flash_sector_class_t xor_diff_flash_classify_sector(const uint8_t* current,
+                                                        const uint8_t* delta,
+                                                        size_t sector_size,
+                                                        uint8_t erased_value);
+
+/* Flash-optimized patch application with minimal writes.
+ * Sparse patches are applied run by run. With config.flash_elide_writes
+ * each sector is classified first: untouched sectors are skipped,
+ * program-only sectors are written without erase, and only the rest are
+ * erased and programmed. Skipped writes and erases are added to
+ * flash_writes_saved / flash_erases_saved. */
 xor_diff_result_t xor_diff_flash_apply(xor_diff_context_t* ctx,
                                        const xor_patch_t* patch,
                                        void* flash_data,
                                        size_t flash_sector_size);
 
-/* Update data in flash using XOR delta with wear leveling */
+/* Flash apply from a borrowed view, e.g. a patch in memory-mapped flash */
+xor_diff_result_t xor_diff_flash_apply_view(xor_diff_context_t* ctx,
+                                            const xor_patch_view_t* view,
+                                            void* flash_data,
+                                            size_t flash_sector_size);
+
+/* Update data in flash using XOR delta with wear leveling. Sectors are
+ * classified as in xor_diff_flash_apply. */
 xor_diff_result_t xor_diff_flash_update(xor_diff_context_t* ctx,
                                         void* flash_addr,
                                         const void* new_data,
                                         size_t data_size,
                                         size_t sector_size);
 
-/* Batch multiple patches for efficient flash writes */
+/* Batch multiple patches for efficient flash writes. All patches are
+ * relative to flash_data and the batch must be one of:
+ * - a chain: patch i+1 was created against the output of patch i
+ *   (patches[i].target_checksum == patches[i + 1].source_checksum); the
+ *   deltas are then composed as in xor_diff_compose_patches
+ * - independent patches against the same base (equal source_checksum)
+ *   whose non-zero deltas do not overlap
+ * Anything else returns XOR_DIFF_ERROR_CHECKSUM_MISMATCH for a broken
+ * chain or XOR_DIFF_ERROR_PATCH_CORRUPT for overlapping independent
+ * patches, before flash is touched. Patches without checksums are treated
+ * as independent. Equivalent to building and executing an
+ * xor_flash_plan_t. */
 xor_diff_result_t xor_diff_flash_batch_apply(xor_diff_context_t* ctx,
                                              const xor_patch_t* patches,
                                              size_t patch_count,
                                              void* flash_data,
                                              size_t flash_size);
 
+/* Merged per-sector erase/program plan for a batch of patches */
+typedef struct {
+    size_t sector_count;        /* Sectors spanned by flash_size */
+    size_t sectors_untouched;   /* Sectors with an all-zero merged delta */
+    size_t erase_count;         /* Sectors erased, each at most once */
+    size_t program_count;       /* Page-sized program bursts */
+    void* buffer;               /* Optional caller storage for the plan */
+    size_t buffer_size;         /* >= xor_diff_flash_plan_required() */
+    void* internal_state;       /* Merged deltas and burst list */
+} xor_flash_plan_t;
+
+/* Plan storage needed for a batch; set plan->buffer/buffer_size before
+ * xor_diff_flash_plan_build to build it without allocating */
+size_t xor_diff_flash_plan_required(const xor_diff_context_t* ctx,
+                                    const xor_patch_t* patches,
+                                    size_t patch_count,
+                                    size_t flash_size);
+
+/* Merge patches into one plan using config.flash_sector_size, with the
+ * same chain/independent rules and errors as xor_diff_flash_batch_apply;
+ * every overlap is checked here, so executing a built plan never mixes
+ * conflicting deltas. Program
+ * bursts never cross a flash_page_size boundary and start and end on
+ * write_alignment; with flash_allow_reorder sectors needing an erase are
+ * grouped ahead of program-only ones. */
+xor_diff_result_t xor_diff_flash_plan_build(xor_diff_context_t* ctx,
+                                            const xor_patch_t* patches,
+                                            size_t patch_count,
+                                            const void* flash_data,
+                                            size_t flash_size,
+                                            xor_flash_plan_t* plan);
+
+/* Run a plan through the flash callbacks */
+xor_diff_result_t xor_diff_flash_plan_execute(xor_diff_context_t* ctx,
+                                              const xor_flash_plan_t* plan,
+                                              void* flash_data);
+
+/* Release plan buffers (a caller-provided buffer is left alone) */
+void xor_diff_flash_plan_free(xor_flash_plan_t* plan);
+
+/* =============================================================================
+ * POWER-FAIL-SAFE FLASH APPLY
+ * =============================================================================
+ * The journal is a sequence of records of record_size bytes each. A record
+ * is programmed once, in a single write, and never reprogrammed, so the
+ * journal also works on ECC flash that allows one program per flash word
+ * (set record_size to the flash word, e.g. 32 on STM32H7). Recording
+ * progress never needs an erase. Layout:
+ *   key       xor_flash_journal_key_t, padded to whole records
+ *   sectors   three records per sector: STARTED, STAGED, DONE
+ * A state record holds its tag, ~tag, the sector's xor_flash_sector_class_t
+ * and ~class in its first four bytes; the rest is written as the erased
+ * value. Each record is written only after the step before it has
+ * completed, so a record torn by a reset (neither erased nor valid) counts
+ * as written.
+ *
+ * Per sector, the class is computed from the untouched contents and
+ * recorded in STARTED before anything in the sector is written.
+ * - Program-only sectors are then programmed with their target bits
+ *   (current & ~delta for erased 0xFF, current | delta for 0x00) and
+ *   marked DONE. On resume, a STARTED program-only sector is finished the
+ *   same way. That is idempotent on a partially programmed sector, where
+ *   reclassifying the contents would wrongly report NEEDS_ERASE.
+ * - Sectors that need an erase get their patched contents written to the
+ *   scratch sector, then STAGED, then erase and program from scratch, then
+ *   DONE. On resume, a STAGED sector is erased and reprogrammed from
+ *   scratch. A sector that is STARTED but not STAGED has not been erased
+ *   yet and is staged again.
+ * - Untouched sectors get no records.
+ * The key holds the wire header_checksum (which covers both data
+ * checksums, sizes and flags) and the CRC32 of patch_data, so a stale
+ * journal never matches a different patch, even one created with
+ * enable_checksum off and zero data checksums.
+ */
+
+#define XOR_FLASH_JOURNAL_MAGIC       0x4A504458u /* "XDPJ" */
+#define XOR_FLASH_JOURNAL_WHOLE_PATCH 0xFFFFFFFFu /* segment_index of full applies */
+
+typedef struct {
+    uint32_t magic;             /* XOR_FLASH_JOURNAL_MAGIC */
+    uint32_t header_checksum;   /* Wire header_checksum of the patch */
+    uint32_t patch_data_crc;    /* CRC32 of patch_data */
+    uint32_t segment_index;     /* Segment, or XOR_FLASH_JOURNAL_WHOLE_PATCH */
+    uint32_t sector_count;
+    uint32_t key_checksum;      /* CRC32 of this key, field taken as 0 */
+} xor_flash_journal_key_t;
+
+typedef char xor_flash_journal_key_size_check[
+    (sizeof(xor_flash_journal_key_t) == 24) ? 1 : -1];
+
+/* State record tags; each differs from both erased values */
+typedef enum {
+    XOR_FLASH_JOURNAL_STARTED = 0x5A, /* Class recorded, sector about to change */
+    XOR_FLASH_JOURNAL_STAGED = 0x6B,  /* Patched sector copied to scratch */
+    XOR_FLASH_JOURNAL_DONE = 0x7C     /* Sector holds its target contents */
+} xor_flash_journal_state_t;
+
+typedef struct {
+    void* journal_addr;         /* Reserved journal area (memory-mapped) */
+    size_t journal_size;        /* >= xor_diff_flash_journal_size() */
+    void* scratch_addr;         /* One spare sector for staging */
+    size_t record_size;         /* Program unit: a multiple of write_alignment,
+                                 * >= 4 (0 = max(4, write_alignment)) */
+} xor_flash_journal_t;
+
+/* Journal bytes needed for a given number of sectors with records of
+ * record_size bytes (the resolved size, not 0) */
+size_t xor_diff_flash_journal_size(size_t sector_count, size_t record_size);
+
+/* Journaled flash apply. Starts a new journal, or resumes from an existing
+ * one recorded for the same patch, through the flash callbacks. A blank
+ * journal, or one whose key record is torn, is erased and started again;
+ * nothing was written under it. */
+xor_diff_result_t xor_diff_flash_apply_journaled(xor_diff_context_t* ctx,
+                                                 const xor_patch_t* patch,
+                                                 void* flash_data,
+                                                 size_t flash_sector_size,
+                                                 const xor_flash_journal_t* journal);
+
+/* Report progress of a journal (sectors_done counts DONE records).
+ * Returns XOR_DIFF_ERROR_VERSION_MISMATCH if the journal's patch key
+ * (header_checksum and patch_data CRC32) differs from this patch's. */
+xor_diff_result_t xor_diff_flash_journal_status(const xor_flash_journal_t* journal,
+                                                const xor_patch_t* patch,
+                                                size_t* sectors_done,
+                                                size_t* sector_count);
+
+/* Erase the journal once the update has been committed */
+xor_diff_result_t xor_diff_flash_journal_clear(xor_diff_context_t* ctx,
+                                               const xor_flash_journal_t* journal);
+
+/* Swap two flash slots (A/B images) sector by sector through one RAM
+ * sector buffer and the flash callbacks. Identical sectors are skipped,
+ * and with config.flash_elide_writes a side whose new contents only clear
+ * bits is programmed without an erase, so each sector costs at most one
+ * erase per slot. sector_buffer holds sector_size bytes (NULL = arena).
+ * With a journal the buffered sector is staged in its scratch sector,
+ * progress is kept in the same write-once per-sector records, and an
+ * interrupted swap resumes at the sector it stopped on. */
+xor_diff_result_t xor_swap_flash_slots(xor_diff_context_t* ctx,
+                                       void* slot_a,
+                                       void* slot_b,
+                                       size_t slot_size,
+                                       size_t sector_size,
+                                       void* sector_buffer,
+                                       const xor_flash_journal_t* journal);
+
+/* =============================================================================
+ * WEAR LEVELING
+ * =============================================================================
+ * Optional layer under xor_diff_flash_update. A region of logical sectors
+ * is backed by logical + spare physical sectors. Erase counts and the
+ * logical-to-physical map live in two metadata sectors written alternately
+ * through the flash callbacks, so an interrupted update keeps the old map.
+ */
+
+typedef struct {
+    void* region_base;          /* First physical sector of the region */
+    size_t sector_size;
+    size_t logical_sectors;     /* Sectors visible to callers */
+    size_t spare_sectors;       /* Extra physical sectors to rotate through */
+    void* meta_addr;            /* Two metadata sectors */
+    uint32_t rotate_threshold;  /* Erase-count gap that triggers a remap */
+} xor_wear_config_t;
+
+typedef struct {
+    xor_wear_config_t config;
+    uint32_t generation;        /* Metadata write sequence number */
+    void* internal_state;       /* Erase counters and sector map */
+} xor_wear_map_t;
+
+/* Load the map from metadata, or format it if none is valid */
+xor_diff_result_t xor_wear_init(xor_diff_context_t* ctx,
+                                xor_wear_map_t* wear,
+                                const xor_wear_config_t* config);
+
+/* Release the in-RAM map */
+void xor_wear_free(xor_wear_map_t* wear);
+
+/* Physical address currently backing a logical sector */
+void* xor_wear_physical_addr(const xor_wear_map_t* wear, size_t logical_sector);
+
+/* Erase count of a physical sector */
+uint32_t xor_wear_erase_count(const xor_wear_map_t* wear, size_t physical_sector);
+
+/* Route xor_diff_flash_update through a wear map (NULL to detach).
+ * flash_addr is then a logical address in the region: each sector is
+ * diffed against its current physical copy, and a sector that needs an
+ * erase is written to the least-worn spare once its erase count leads by
+ * rotate_threshold, the old copy becoming a spare. */
+xor_diff_result_t xor_diff_set_wear_map(xor_diff_context_t* ctx,
+                                        xor_wear_map_t* wear);
+
+/* =============================================================================
+ * VIRTUAL PATCHED IMAGE
+ * =============================================================================
+ * Read the patched image without rewriting it first. Reads return source
+ * bytes XORed with the overlapping patch runs, with recently materialized
+ * sectors kept in a small cache. Sectors are committed to flash later in
+ * small steps through the flash callbacks; committed sectors are read
+ * straight from flash.
+ */
+
+typedef struct {
+    xor_diff_context_t* ctx;
+    const xor_patch_t* patch;   /* Must outlive the image */
+    void* source;               /* Source image (memory-mapped flash) */
+    size_t sector_size;         /* Materialization and commit unit */
+    size_t sector_count;
+    size_t sectors_committed;
+    void* internal_state;       /* Sector cache and commit bitmap */
+} xor_patched_image_t;
+
+/* Open a virtual image over source and patch. cache_sectors bounds the
+ * RAM used for materialized sectors. journal records which sectors have
+ * been committed in place and stages sectors that need an erase, so after
+ * a reset DONE sectors are read from flash rather than XORed a second
+ * time, and a STARTED or STAGED sector is finished by the next commit
+ * before it is read. journal may be NULL only for a read-only image that is
+ * never committed. */
+xor_diff_result_t xor_patched_image_open(xor_diff_context_t* ctx,
+                                         xor_patched_image_t* image,
+                                         const xor_patch_t* patch,
+                                         void* source,
+                                         size_t sector_size,
+                                         size_t cache_sectors,
+                                         const xor_flash_journal_t* journal);
+
+/* Read patched bytes at offset */
+xor_diff_result_t xor_patched_image_read(xor_patched_image_t* image,
+                                         uint64_t offset,
+                                         void* buffer,
+                                         size_t size);
+
+/* Commit up to max_sectors more sectors to flash (call from a background
+ * task) with the per-sector STARTED/STAGED/DONE records and resume rules of
+ * xor_diff_flash_apply_journaled, keyed as a whole-patch apply.
+ * Untouched sectors are skipped as in xor_diff_flash_apply. *done is set
+ * once the whole image is committed. Returns XOR_DIFF_ERROR_NULL_POINTER
+ * if the image was opened without a journal. */
+xor_diff_result_t xor_patched_image_commit(xor_patched_image_t* image,
+                                           size_t max_sectors,
+                                           bool* done);
+
+/* Release the cache. Uncommitted sectors stay virtual; reopen with the
+ * same journal to continue reading and committing. */
+void xor_patched_image_close(xor_patched_image_t* image);
+
+/* =============================================================================
+ * CHUNKED PATCHES (APPLY WHILE DOWNLOADING)
+ * =============================================================================
+ * A chunked patch is the wire header with XOR_PATCH_FLAG_CHUNKED followed
+ * by chunks in ascending data_offset. Each chunk covers one region of the
+ * image (typically a flash sector) and carries its own length and CRC, so
+ * it can be verified and programmed as soon as it has arrived. Payloads
+ * are sparse runs relative to data_offset. Fields are little-endian.
+ */
+
+#define XOR_PATCH_CHUNK_MAGIC 0x43504458u /* "XDPC" */
+
+typedef struct {
+    uint32_t magic;             /* XOR_PATCH_CHUNK_MAGIC */
+    uint32_t sequence;          /* 0, 1, 2, ... */
+    uint64_t data_offset;       /* Image offset covered by this chunk */
+    uint32_t data_length;       /* Image bytes covered */
+    uint32_t payload_size;      /* Payload bytes following this header */
+    uint32_t payload_crc;       /* CRC32 of the payload */
+    uint32_t header_crc;        /* CRC32 of this header, field taken as 0 */
+    uint8_t flags;              /* XOR_PATCH_FLAG_CODEC_* of the payload */
+    uint8_t reserved[7];        /* Must be zero */
+} xor_patch_chunk_header_t;
+
+typedef char xor_patch_chunk_header_size_check[
+    (sizeof(xor_patch_chunk_header_t) == 40) ? 1 : -1];
+
+/* Serialize a patch as chunks covering chunk_data_size image bytes each
+ * (a multiple of the target's sector size) */
+xor_diff_result_t xor_patch_serialize_chunked(const xor_patch_t* patch,
+                                              size_t chunk_data_size,
+                                              xor_patch_sink_fn sink,
+                                              void* user_data);
+
+/* Incremental consumer that verifies and programs chunks as they arrive */
+typedef struct {
+    xor_diff_context_t* ctx;
+    void* flash_data;
+    size_t sector_size;
+    uint32_t next_sequence;     /* Next chunk expected; resend from here */
+    uint64_t bytes_consumed;    /* Serialized bytes accepted so far */
+    void* internal_state;       /* Buffer for one partial chunk */
+} xor_flash_chunk_reader_t;
+
+/* Start a chunked flash apply; pair with finish or abort. With a
+ * journal, chunks already programmed before a reset are skipped and
+ * next_sequence tells the sender where to resume. */
+xor_diff_result_t xor_diff_flash_apply_chunked_begin(xor_diff_context_t* ctx,
+                                                     xor_flash_chunk_reader_t* reader,
+                                                     void* flash_data,
+                                                     size_t flash_sector_size,
+                                                     const xor_flash_journal_t* journal);
+
+/* Feed bytes from a socket or UART ring buffer in any fragmentation. A
+ * chunk failing its CRC returns XOR_DIFF_ERROR_CHECKSUM_MISMATCH without
+ * touching flash; the reader can then be fed again from next_sequence. */
+xor_diff_result_t xor_diff_flash_apply_chunked_feed(xor_flash_chunk_reader_t* reader,
+                                                    const uint8_t* data,
+                                                    size_t size);
+
+/* Check that every chunk arrived (and the target CRC when enable_checksum
+ * is set), then release the reader; it is released even when an error is
+ * returned */
+xor_diff_result_t xor_diff_flash_apply_chunked_finish(xor_flash_chunk_reader_t* reader);
+
+/* Release the reader without checking completion, e.g. when the download
+ * is abandoned. The journal is left as is, so a later begin with it
+ * resumes from the chunks already programmed. Safe to call twice. */
+void xor_diff_flash_apply_chunked_abort(xor_flash_chunk_reader_t* reader);
+
 /* =============================================================================
  * PATCH MANAGEMENT
  * =============================================================================
@@ -166,6 +1030,21 @@ xor_diff_result_t xor_diff_flash_batch_apply(xor_diff_context_t* ctx,
 /* Allocate patch structure */
 xor_patch_t* xor_patch_alloc(size_t patch_size);
 
+/* Initialize a caller-owned patch to the empty state, with buffers from
+ * allocator (NULL = malloc/free). No allocation. */
+void xor_patch_init(xor_patch_t* patch, const xor_diff_allocator_t* allocator);
+
+/* Free patch_data of a caller-owned patch and reset it to the empty state
+ * (the allocator is kept); the struct itself is not freed */
+void xor_patch_release(xor_patch_t* patch);
+
+/* Allocate patch structure and data through an allocator */
+xor_patch_t* xor_patch_alloc_with(size_t patch_size,
+                                  const xor_diff_allocator_t* allocator);
+
+/* Grow patch_data to at least `capacity` bytes; never shrinks */
+xor_diff_result_t xor_patch_reserve(xor_patch_t* patch, size_t capacity);
+
 /* Free patch structure */
 void xor_patch_free(xor_patch_t* patch);
 
@@ -175,29 +1054,97 @@ xor_diff_result_t xor_patch_validate(const xor_patch_t* patch);
 /* Compress patch data using RLE */
 xor_diff_result_t xor_patch_compress(xor_patch_t* patch);
 
-/* Decompress patch data */
+/* Compress patch data with a registered codec; the codec id is recorded
+ * in header.flags and the level in header.compression_level */
+xor_diff_result_t xor_patch_compress_codec(xor_patch_t* patch,
+                                           uint8_t codec,
+                                           uint8_t level);
+
+/* Decompress patch data with the codec recorded in header.flags.
+ * Returns XOR_DIFF_ERROR_UNSUPPORTED for an unregistered codec. */
 xor_diff_result_t xor_patch_decompress(xor_patch_t* patch);
 
-/* Serialize patch to buffer */
+/* Register a codec (e.g. zstd when linked). Returns
+ * XOR_DIFF_ERROR_INVALID_SIZE if codec->id is out of range. */
+xor_diff_result_t xor_diff_register_codec(const xor_patch_codec_ops_t* codec);
+
+/* Look up a codec by id, or NULL if none is registered */
+const xor_patch_codec_ops_t* xor_diff_find_codec(uint8_t id);
+
+/* Iterate the runs of a sparse patch without expanding it. Start with
+ * *cursor = 0; each call fills *run, points *payload at the run's XOR bytes
+ * inside patch_data and advances *cursor. Returns false after the last run. */
+bool xor_patch_next_run(const xor_patch_t* patch,
+                        size_t* cursor,
+                        xor_patch_run_t* run,
+                        const uint8_t** payload);
+
+/* Number of bytes a sparse encoding of a dense patch would occupy */
+size_t xor_patch_sparse_size(const xor_patch_t* patch, size_t merge_gap);
+
+/* Serialize patch to buffer: wire header followed by patch_data */
 xor_diff_result_t xor_patch_serialize(const xor_patch_t* patch,
                                       uint8_t* buffer,
                                       size_t buffer_size,
                                       size_t* bytes_written);
 
-/* Deserialize patch from buffer */
+/* Deserialize patch from buffer into an initialized patch (copies
+ * patch_data). Returns
+ * XOR_DIFF_ERROR_PATCH_CORRUPT on bad magic or header checksum and
+ * XOR_DIFF_ERROR_VERSION_MISMATCH on an unknown format_version. */
 xor_diff_result_t xor_patch_deserialize(const uint8_t* buffer,
                                         size_t buffer_size,
                                         xor_patch_t* patch);
 
+/* Map a serialized patch without copying. Checks the wire header as
+ * xor_patch_deserialize does and that patch_data lies within buffer_size;
+ * the buffer must outlive the view. buffer must be 8-byte aligned so the
+ * header's uint64_t fields can be loaded in place (Cortex-M0 faults on
+ * unaligned loads); otherwise XOR_DIFF_ERROR_MISALIGNED is returned and
+ * the caller should receive into an aligned buffer or use
+ * xor_patch_deserialize. */
+xor_diff_result_t xor_patch_view_init(const uint8_t* buffer,
+                                      size_t buffer_size,
+                                      xor_patch_view_t* view);
+
+/* Convert between the in-memory and on-wire headers. On little-endian
+ * targets decoding is plain loads; header_checksum is filled/verified. */
+void xor_patch_wire_encode(const xor_patch_header_t* header,
+                           xor_patch_wire_header_t* wire);
+
+xor_diff_result_t xor_patch_wire_decode(const xor_patch_wire_header_t* wire,
+                                        xor_patch_header_t* header);
+
+/* Iterate the runs of a sparse view, as xor_patch_next_run */
+bool xor_patch_view_next_run(const xor_patch_view_t* view,
+                             size_t* cursor,
+                             xor_patch_run_t* run,
+                             const uint8_t** payload);
+
 /* =============================================================================
  * UTILITY FUNCTIONS
  * =============================================================================
  */
 
-/* Calculate CRC32 checksum */
+/* Calculate CRC32 checksum (IEEE 802.3, reflected 0xEDB88320).
+ * Same result as xor_diff_crc32_final(xor_diff_crc32_update(
+ * XOR_DIFF_CRC32_INIT, data, size)). */
 uint32_t xor_diff_crc32(const void* data, size_t size);
 
-/* Compare two data blocks efficiently */
+/* Incremental CRC32, so checksums can be folded into another pass:
+ *   uint32_t crc = XOR_DIFF_CRC32_INIT;
+ *   crc = xor_diff_crc32_update(crc, chunk, chunk_size);   (repeat)
+ *   checksum = xor_diff_crc32_final(crc);                              */
+#define XOR_DIFF_CRC32_INIT 0xFFFFFFFFu
+
+uint32_t xor_diff_crc32_update(uint32_t state, const void* data, size_t size);
+
+uint32_t xor_diff_crc32_final(uint32_t state);
+
+/* CRC32 of A||B from crc(A), crc(B) and len(B); merges per-block CRCs */
+uint32_t xor_diff_crc32_combine(uint32_t crc_a, uint32_t crc_b, uint64_t size_b);
+
+/* Compare two data blocks efficiently (uses the detected kernels) */
 bool xor_diff_data_equal(const void* data_a, const void* data_b, size_t size);
 
 /* Find first difference between two blocks */
@@ -227,27 +1174,289 @@ xor_diff_result_t xor_diff_apply_chain(xor_diff_context_t* ctx,
                                        size_t chain_length,
                                        void* data);
 
-/* Optimize patch for specific access patterns */
+/* Merge a sequence of patches into one equivalent patch (XOR deltas
+ * compose by XOR). The result has the first patch's source_checksum and
+ * the last patch's target_checksum, and is sparse when
+ * config.enable_sparse is set; composed must be initialized. Returns
+ * XOR_DIFF_ERROR_CHECKSUM_MISMATCH if one patch's target does not match
+ * the next patch's source. */
+xor_diff_result_t xor_diff_compose_patches(xor_diff_context_t* ctx,
+                                           const xor_patch_t* patches,
+                                           size_t patch_count,
+                                           xor_patch_t* composed);
+
+/* Skip-list index over a patch chain. Level k holds composed patches from
+ * version j*2^k to (j+1)*2^k, so any jump takes O(log n) applications. */
+typedef struct {
+    size_t version_count;       /* chain_length + 1 */
+    size_t level_count;         /* Levels of skip patches */
+    void* internal_state;       /* Composed skip patches */
+} xor_chain_index_t;
+
+/* Build the index from a patch chain (version i -> i + 1) */
+xor_diff_result_t xor_diff_chain_index_build(xor_diff_context_t* ctx,
+                                             const xor_patch_t* patch_chain,
+                                             size_t chain_length,
+                                             xor_chain_index_t* index);
+
+/* Move data from version from_version to to_version, in either direction
+ * (XOR patches are their own inverse) */
+xor_diff_result_t xor_diff_chain_index_apply(xor_diff_context_t* ctx,
+                                             const xor_chain_index_t* index,
+                                             size_t from_version,
+                                             size_t to_version,
+                                             void* data);
+
+/* Release skip patches */
+void xor_diff_chain_index_free(xor_chain_index_t* index);
+
+/* Per-block priority map: priorities[i] covers block i of block_size
+ * bytes; 0 = boot-critical, applied first, 255 = coldest */
+typedef struct {
+    size_t block_size;
+    size_t block_count;         /* Must cover header.data_size */
+    const uint8_t* priorities;
+} xor_access_pattern_t;
+
+/* Segmented patch layout: patch_data starts with an
+ * xor_patch_segment_table_t, then segment_count xor_patch_segment_t
+ * entries in priority order, then the segment bodies (sparse runs), so
+ * every entry is 8-byte aligned. source_crc / target_crc are the CRC32 of
+ * the bytes covered by the segment's runs before / after it is applied. */
+typedef struct {
+    uint32_t segment_count;
+    uint32_t block_size;        /* Block size of the access pattern */
+} xor_patch_segment_table_t;
+
+typedef struct {
+    uint32_t priority;
+    uint32_t source_crc;
+    uint32_t target_crc;
+    uint32_t reserved;          /* Must be zero */
+    uint64_t body_offset;       /* From the start of patch_data */
+    uint64_t body_size;
+} xor_patch_segment_t;
+
+typedef char xor_patch_segment_size_check[
+    (sizeof(xor_patch_segment_table_t) == 8 &&
+     sizeof(xor_patch_segment_t) == 32) ? 1 : -1];
+
+/* Optimize patch for specific access patterns. access_pattern holds one
+ * priority byte per XOR_DIFF_DEFAULT_BLOCK_SIZE block of the data, as
+ * xor_diff_optimize_patch_ex with that block size. */
 xor_diff_result_t xor_diff_optimize_patch(xor_patch_t* patch,
                                           const uint8_t* access_pattern);
 
+/* Split a patch into one segment per distinct priority (runs are cut at
+ * block boundaries) and sort the segments hottest first. Sets
+ * XOR_PATCH_FLAG_SEGMENTED; xor_diff_apply_patch still applies it whole. */
+xor_diff_result_t xor_diff_optimize_patch_ex(xor_patch_t* patch,
+                                             const xor_access_pattern_t* pattern);
+
+/* Number of segments (1 for a patch that is not segmented) */
+size_t xor_patch_segment_count(const xor_patch_t* patch);
+
+/* Read a segment table entry */
+xor_diff_result_t xor_patch_get_segment(const xor_patch_t* patch,
+                                        size_t index,
+                                        xor_patch_segment_t* segment);
+
+/* Apply one segment in place, e.g. the boot-critical one before first
+ * boot and the rest lazily afterwards. The covered bytes are checked
+ * first: if they already match target_crc the call does nothing, if they
+ * match source_crc the segment is applied, and otherwise (a segment left
+ * half-applied) XOR_DIFF_ERROR_CHECKSUM_MISMATCH is returned without
+ * writing. Repeating the call is therefore safe; for interruption-safe
+ * application to flash use xor_diff_flash_apply_segment_journaled. */
+xor_diff_result_t xor_diff_apply_segment(xor_diff_context_t* ctx,
+                                         const xor_patch_t* patch,
+                                         size_t index,
+                                         void* data);
+
+/* Check an applied segment against its target_crc */
+xor_diff_result_t xor_diff_verify_segment(const xor_patch_t* patch,
+                                          size_t index,
+                                          const void* data);
+
+/* Power-fail-safe apply of one segment to flash, with the same per-sector
+ * records and resume rules as xor_diff_flash_apply_journaled. The journal
+ * key carries the segment index, so a background task can apply segments
+ * one after another, each resumable after a reset.
+ * Verifies target_crc once all sectors of the segment are done. */
+xor_diff_result_t xor_diff_flash_apply_segment_journaled(xor_diff_context_t* ctx,
+                                                         const xor_patch_t* patch,
+                                                         size_t index,
+                                                         void* flash_data,
+                                                         size_t flash_sector_size,
+                                                         const xor_flash_journal_t* journal);
+
+#ifdef XOR_DIFF_ENABLE_PROFILING
+
+/* Profiled phases */
+typedef enum {
+    XOR_DIFF_PHASE_DIFF = 0,
+    XOR_DIFF_PHASE_CRC,
+    XOR_DIFF_PHASE_COMPRESS,
+    XOR_DIFF_PHASE_DECOMPRESS,
+    XOR_DIFF_PHASE_FLASH_ERASE,
+    XOR_DIFF_PHASE_FLASH_WRITE,
+    XOR_DIFF_PHASE_CALLBACK_WAIT,
+    XOR_DIFF_PHASE_COUNT
+} xor_diff_phase_t;
+
+/* Latency histogram: bucket 0 is < 1 us, bucket i is [2^(i-1), 2^i) us,
+ * the last bucket is open-ended */
+#define XOR_DIFF_HIST_BUCKETS 20
+
+typedef struct {
+    uint64_t count;             /* Phase invocations */
+    uint64_t total_ticks;
+    uint64_t max_ticks;
+    uint64_t bytes;             /* Bytes handled in this phase */
+    uint32_t histogram[XOR_DIFF_HIST_BUCKETS];
+} xor_diff_phase_stats_t;
+
+/* Per-phase report, kept out of xor_diff_stats_t so that struct has the
+ * same layout whether or not profiling is compiled in */
+typedef struct {
+    uint64_t ticks_per_second;  /* Of the clock source in use */
+    xor_diff_phase_stats_t phases[XOR_DIFF_PHASE_COUNT];
+} xor_diff_phase_report_t;
+
+#endif /* XOR_DIFF_ENABLE_PROFILING */
+
 /* Statistics and profiling */
 typedef struct {
     size_t patches_created;
     size_t patches_applied;
     size_t bytes_processed;
     size_t flash_writes_saved;
+    size_t flash_erases_saved;
+    size_t cache_hits;
+    size_t cache_misses;
     double compression_ratio;
     uint64_t processing_time_us;
 } xor_diff_stats_t;
 
-/* Get operation statistics */
+/* Get operation statistics. For a context acquired from a shared engine
+ * this is the engine-wide total merged from all shards. */
 xor_diff_result_t xor_diff_get_stats(const xor_diff_context_t* ctx,
                                      xor_diff_stats_t* stats);
 
 /* Reset statistics */
 void xor_diff_reset_stats(xor_diff_context_t* ctx);
 
+#ifdef XOR_DIFF_ENABLE_PROFILING
+
+/* Clock source returning monotonically increasing ticks */
+typedef uint64_t (*xor_clock_fn)(void* user_data);
+
+/* Select the clock used for phase timing (default: monotonic clock) */
+xor_diff_result_t xor_diff_set_clock(xor_diff_context_t* ctx,
+                                     xor_clock_fn clock_fn,
+                                     uint64_t ticks_per_second,
+                                     void* user_data);
+
+/* clock_gettime(CLOCK_MONOTONIC) in nanoseconds (hosted builds) */
+uint64_t xor_diff_clock_monotonic(void* user_data);
+
+/* Cortex-M DWT->CYCCNT extended to 64 bits; the caller enables DWT and
+ * passes the core clock as ticks_per_second. Wraps are detected between
+ * samples, so the clock must be sampled at least once per CYCCNT wrap
+ * (2^32 cycles, about 8.9 s at 480 MHz); phases are sampled at their
+ * boundaries, so longer phases need a periodic call from a timer tick. */
+uint64_t xor_diff_clock_dwt(void* user_data);
+
+/* Per-phase timing since the last xor_diff_reset_stats */
+xor_diff_result_t xor_diff_get_phase_stats(const xor_diff_context_t* ctx,
+                                           xor_diff_phase_report_t* report);
+
+#endif /* XOR_DIFF_ENABLE_PROFILING */
+
+/* =============================================================================
+ * PATCH CACHE
+ * =============================================================================
+ * Server-side cache of created patches keyed by xor_patch_cache_key_t:
+ * the data checksums and size plus every setting that changes the
+ * encoded bytes. In-memory LRU bounded by a byte budget; evicted entries
+ * can spill to disk in the serialized format. Internally locked, so one
+ * cache may be shared by many contexts with different configs.
+ */
+
+typedef struct xor_patch_cache xor_patch_cache_t;
+
+typedef struct {
+    uint32_t source_checksum;
+    uint32_t target_checksum;
+    uint64_t data_size;
+    uint64_t sparse_merge_gap;  /* 0 for dense patches */
+    uint8_t flags;              /* XOR_PATCH_FLAG_* incl. codec id */
+    uint8_t compression_level;
+    uint8_t reserved[6];        /* Must be zero */
+} xor_patch_cache_key_t;
+
+/* Build the key for a source/target pair created with `config` */
+void xor_patch_cache_make_key(const xor_diff_config_t* config,
+                              uint32_t source_checksum,
+                              uint32_t target_checksum,
+                              uint64_t data_size,
+                              xor_patch_cache_key_t* key);
+
+/* Create a cache. spill_dir may be NULL for memory only. Spilling needs
+ * XOR_DIFF_ENABLE_FILE_IO: on builds without it a non-NULL spill_dir
+ * makes this return NULL instead of being silently ignored. */
+xor_patch_cache_t* xor_patch_cache_create(size_t byte_budget, const char* spill_dir);
+
+/* Destroy a cache and its in-memory entries */
+void xor_patch_cache_destroy(xor_patch_cache_t* cache);
+
+/* Look up a patch; on a hit the initialized *patch receives an owned copy
+ * (its buffer is reused) */
+bool xor_patch_cache_lookup(xor_patch_cache_t* cache,
+                            const xor_patch_cache_key_t* key,
+                            xor_patch_t* patch);
+
+/* Insert a copy of a patch under key, evicting least recently used
+ * entries */
+xor_diff_result_t xor_patch_cache_insert(xor_patch_cache_t* cache,
+                                         const xor_patch_cache_key_t* key,
+                                         const xor_patch_t* patch);
+
+/* Attach a cache to a context (NULL to detach). xor_diff_create_patch then
+ * CRCs both inputs, looks up the key built from the context's config,
+ * returns a cached patch on a hit and inserts on a miss;
+ * cache_hits / cache_misses are reported in xor_diff_stats_t. */
+xor_diff_result_t xor_diff_set_patch_cache(xor_diff_context_t* ctx,
+                                           xor_patch_cache_t* cache);
+
+/* =============================================================================
+ * SHARED ENGINE
+ * =============================================================================
+ * One read-only config, kernel table, worker pool and patch cache shared
+ * by many threads. Each thread acquires a cheap context whose counters go
+ * to its own cache-line-padded shard of atomic counters, so threads never
+ * contend on statistics.
+ */
+
+typedef struct xor_diff_shared xor_diff_shared_t;
+
+/* Create a shared engine. shard_count 0 = one shard per CPU. */
+xor_diff_shared_t* xor_diff_shared_create(const xor_diff_config_t* config,
+                                          size_t shard_count);
+
+/* Destroy a shared engine; all acquired contexts must be cleaned up first */
+void xor_diff_shared_destroy(xor_diff_shared_t* shared);
+
+/* Initialize a per-thread context backed by the shared engine (no
+ * allocation). Release it with xor_diff_cleanup. Its total_operations and
+ * bytes_processed fields are not used; query xor_diff_get_stats. */
+xor_diff_result_t xor_diff_shared_acquire(xor_diff_shared_t* shared,
+                                          xor_diff_context_t* ctx);
+
+/* Engine-wide statistics merged from all shards */
+xor_diff_result_t xor_diff_shared_get_stats(const xor_diff_shared_t* shared,
+                                            xor_diff_stats_t* stats);
+
 /* =============================================================================
  * CALLBACK DEFINITIONS
  * =============================================================================
@@ -278,31 +1487,104 @@ xor_diff_result_t xor_diff_set_progress_callback(xor_diff_context_t* ctx,
                                                  xor_progress_fn progress_fn,
                                                  void* user_data);
 
+/* Completion of an async flash operation; may run in interrupt context */
+typedef void (*xor_flash_complete_fn)(xor_diff_result_t result, void* done_arg);
+
+/* Async flash write: start the transfer (DMA/QSPI) and return, then call
+ * done(result, done_arg) once programming has finished. `data` stays
+ * valid until then. */
+typedef xor_diff_result_t (*xor_flash_write_async_fn)(void* flash_addr,
+                                                      const void* data,
+                                                      size_t size,
+                                                      xor_flash_complete_fn done,
+                                                      void* done_arg,
+                                                      void* user_data);
+
+/* Async flash erase */
+typedef xor_diff_result_t (*xor_flash_erase_async_fn)(void* flash_addr,
+                                                      size_t size,
+                                                      xor_flash_complete_fn done,
+                                                      void* done_arg,
+                                                      void* user_data);
+
+/* Called while waiting for a completion (e.g. to sleep until interrupt) */
+typedef void (*xor_flash_idle_fn)(void* user_data);
+
+/* Set async flash callbacks. When set, the flash functions stage up to
+ * config.flash_pipeline_depth sectors: the next sector's XOR and CRC run
+ * while the current one is being erased/programmed. idle_fn may be NULL. */
+xor_diff_result_t xor_diff_set_flash_async_callbacks(xor_diff_context_t* ctx,
+                                                     xor_flash_write_async_fn write_fn,
+                                                     xor_flash_erase_async_fn erase_fn,
+                                                     xor_flash_idle_fn idle_fn,
+                                                     void* user_data);
+
 /* =============================================================================
  * INLINE HELPER FUNCTIONS (for performance-critical paths)
  * =============================================================================
  */
 
+#if defined(XOR_DIFF_ENABLE_INLINE) || defined(__cplusplus)
+
+/* Shared by the fixed-geometry C kernels and xor_diff::BlockEngine */
+
+/* Full unroll of a constant 8-iteration loop; plain loop elsewhere */
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8)
+#define XOR_DIFF_UNROLL_8 _Pragma("GCC unroll 8")
+#else
+#define XOR_DIFF_UNROLL_8
+#endif
+
+/* Promise that ptr is align-byte aligned (align a power of two) */
+#if defined(__GNUC__) || defined(__clang__)
+#define XOR_DIFF_ASSUME_ALIGNED(ptr, align) __builtin_assume_aligned((ptr), (align))
+#else
+#define XOR_DIFF_ASSUME_ALIGNED(ptr, align) ((void*)(ptr))
+#endif
+
+/* CRC32 (reflected 0xEDB88320) of one nibble: 64 bytes of table, for the
+ * constant-bound, small-code CRC of the fixed-geometry kernels. Slower
+ * than the runtime slicing-by-8 or hardware kernels, which suits
+ * single-geometry bootloaders. */
+static const uint32_t xor_diff_crc32_nibble_table[16] = {
+    0x00000000u, 0x1DB71064u, 0x3B6E20C8u, 0x26D930ACu,
+    0x76DC4190u, 0x6B6B51F4u, 0x4DB26158u, 0x5005713Cu,
+    0xEDB88320u, 0xF00F9344u, 0xD6D6A3E8u, 0xCB61B38Cu,
+    0x9B64C2B0u, 0x86D3D2D4u, 0xA00AE278u, 0xBDBDF21Cu
+};
+
+#endif /* XOR_DIFF_ENABLE_INLINE || __cplusplus */
+
 #ifdef XOR_DIFF_ENABLE_INLINE
 
-/* Fast XOR operation for aligned data */
+#include <string.h>
+
+/* Fast XOR operation, any alignment (memcpy compiles to plain word loads) */
 static inline void xor_diff_fast_xor(uint8_t* dest, const uint8_t* src, size_t size) {
-    const uint64_t* src64 = (const uint64_t*)src;
-    uint64_t* dest64 = (uint64_t*)dest;
     size_t blocks = size / 8;
     
     for (size_t i = 0; i < blocks; i++) {
-        dest64[i] ^= src64[i];
+        uint64_t d, s;
+        memcpy(&d, dest + i * 8, 8);
+        memcpy(&s, src + i * 8, 8);
+        d ^= s;
+        memcpy(dest + i * 8, &d, 8);
     }
     
     /* Handle remaining bytes */
-    size_t remaining = size % 8;
-    if (remaining) {
-        uint8_t* dest8 = (uint8_t*)(dest64 + blocks);
-        const uint8_t* src8 = (const uint8_t*)(src64 + blocks);
-        for (size_t i = 0; i < remaining; i++) {
-            dest8[i] ^= src8[i];
-        }
+    for (size_t i = blocks * 8; i < size; i++) {
+        dest[i] ^= src[i];
+    }
+}
+
+/* XOR through the context's dispatched kernel (SIMD when available) */
+static inline void xor_diff_fast_xor_ctx(const xor_diff_context_t* ctx,
+                                         uint8_t* dest, const uint8_t* src,
+                                         size_t size) {
+    if (ctx->kernels) {
+        ctx->kernels->xor_into(dest, src, size);
+    } else {
+        xor_diff_fast_xor(dest, src, size);
     }
 }
 
@@ -311,6 +1593,119 @@ static inline bool xor_diff_is_aligned(const void* ptr, size_t alignment) {
     return ((uintptr_t)ptr % alignment) == 0;
 }
 
+/* Fixed-geometry kernels. XOR_DIFF_DEFINE_BLOCK_KERNELS(prefix, size, align)
+ * defines prefix_xor, prefix_xor_pair, prefix_swap, prefix_is_zero and
+ * prefix_crc32_update for exactly `size`-byte blocks whose pointers are
+ * `align`-byte aligned (align a literal 1, 2, 4 or 8; size a multiple of
+ * it). align is an alignment promise to the compiler, not a load width:
+ * data is always processed in 64-bit words, eight per fully unrolled
+ * 64-byte chunk, with constant loop bounds and a constant-size tail, so
+ * the kernels are at least as wide as xor_diff_fast_xor.
+ * prefix_crc32_update uses the shared nibble table (see above). */
+#define XOR_DIFF_DEFINE_BLOCK_KERNELS(prefix, size, align)                     \
+    typedef char prefix##_geometry_check[                                      \
+        ((align) == 1 || (align) == 2 || (align) == 4 || (align) == 8) &&       \
+        (size) > 0 && (size) % (align) == 0 ? 1 : -1];                          \
+    static inline void prefix##_xor(uint8_t* dest, const uint8_t* src) {      \
+        uint8_t* d_ = (uint8_t*)XOR_DIFF_ASSUME_ALIGNED(dest, align);          \
+        const uint8_t* s_ = (const uint8_t*)XOR_DIFF_ASSUME_ALIGNED(src, align); \
+        for (size_t i = 0; i < (size) / 64 * 64; i += 64) {                    \
+            XOR_DIFF_UNROLL_8                                                  \
+            for (size_t j = i; j < i + 64; j += 8) {                           \
+                uint64_t d, s;                                                 \
+                memcpy(&d, d_ + j, 8);                                         \
+                memcpy(&s, s_ + j, 8);                                         \
+                d ^= s;                                                        \
+                memcpy(d_ + j, &d, 8);                                         \
+            }                                                                  \
+        }                                                                      \
+        for (size_t j = (size) / 64 * 64; j < (size) / 8 * 8; j += 8) {        \
+            uint64_t d, s;                                                     \
+            memcpy(&d, d_ + j, 8);                                             \
+            memcpy(&s, s_ + j, 8);                                             \
+            d ^= s;                                                            \
+            memcpy(d_ + j, &d, 8);                                             \
+        }                                                                      \
+        for (size_t j = (size) / 8 * 8; j < (size); j++) {                     \
+            d_[j] ^= s_[j];                                                    \
+        }                                                                      \
+    }                                                                          \
+    static inline void prefix##_xor_pair(uint8_t* dest, const uint8_t* a,    \
+                                         const uint8_t* b) {                   \
+        uint8_t* d_ = (uint8_t*)XOR_DIFF_ASSUME_ALIGNED(dest, align);          \
+        const uint8_t* a_ = (const uint8_t*)XOR_DIFF_ASSUME_ALIGNED(a, align); \
+        const uint8_t* b_ = (const uint8_t*)XOR_DIFF_ASSUME_ALIGNED(b, align); \
+        for (size_t i = 0; i < (size) / 64 * 64; i += 64) {                    \
+            XOR_DIFF_UNROLL_8                                                  \
+            for (size_t j = i; j < i + 64; j += 8) {                           \
+                uint64_t x, y;                                                 \
+                memcpy(&x, a_ + j, 8);                                         \
+                memcpy(&y, b_ + j, 8);                                         \
+                x ^= y;                                                        \
+                memcpy(d_ + j, &x, 8);                                         \
+            }                                                                  \
+        }                                                                      \
+        for (size_t j = (size) / 64 * 64; j < (size) / 8 * 8; j += 8) {        \
+            uint64_t x, y;                                                     \
+            memcpy(&x, a_ + j, 8);                                             \
+            memcpy(&y, b_ + j, 8);                                             \
+            x ^= y;                                                            \
+            memcpy(d_ + j, &x, 8);                                             \
+        }                                                                      \
+        for (size_t j = (size) / 8 * 8; j < (size); j++) {                     \
+            d_[j] = (uint8_t)(a_[j] ^ b_[j]);                                  \
+        }                                                                      \
+    }                                                                          \
+    static inline void prefix##_swap(uint8_t* a, uint8_t* b) {                \
+        uint8_t* a_ = (uint8_t*)XOR_DIFF_ASSUME_ALIGNED(a, align);             \
+        uint8_t* b_ = (uint8_t*)XOR_DIFF_ASSUME_ALIGNED(b, align);             \
+        for (size_t i = 0; i < (size) / 64 * 64; i += 64) {                    \
+            XOR_DIFF_UNROLL_8                                                  \
+            for (size_t j = i; j < i + 64; j += 8) {                           \
+                uint64_t x, y;                                                 \
+                memcpy(&x, a_ + j, 8);                                         \
+                memcpy(&y, b_ + j, 8);                                         \
+                memcpy(a_ + j, &y, 8);                                         \
+                memcpy(b_ + j, &x, 8);                                         \
+            }                                                                  \
+        }                                                                      \
+        for (size_t j = (size) / 64 * 64; j < (size); j++) {                   \
+            uint8_t t = a_[j];                                                 \
+            a_[j] = b_[j];                                                     \
+            b_[j] = t;                                                         \
+        }                                                                      \
+    }                                                                          \
+    static inline bool prefix##_is_zero(const uint8_t* data) {                \
+        const uint8_t* p_ = (const uint8_t*)XOR_DIFF_ASSUME_ALIGNED(data, align); \
+        uint64_t acc = 0;                                                      \
+        for (size_t i = 0; i < (size) / 64 * 64; i += 64) {                    \
+            XOR_DIFF_UNROLL_8                                                  \
+            for (size_t j = i; j < i + 64; j += 8) {                           \
+                uint64_t w;                                                    \
+                memcpy(&w, p_ + j, 8);                                         \
+                acc |= w;                                                      \
+            }                                                                  \
+        }                                                                      \
+        for (size_t j = (size) / 64 * 64; j < (size); j++) {                   \
+            acc |= p_[j];                                                      \
+        }                                                                      \
+        return acc == 0;                                                       \
+    }                                                                          \
+    static inline uint32_t prefix##_crc32_update(uint32_t state,              \
+                                                 const uint8_t* data) {        \
+        for (size_t i = 0; i < (size); i++) {                                  \
+            state ^= data[i];                                                  \
+            state = (state >> 4) ^ xor_diff_crc32_nibble_table[state & 0x0Fu]; \
+            state = (state >> 4) ^ xor_diff_crc32_nibble_table[state & 0x0Fu]; \
+        }                                                                      \
+        return state;                                                          \
+    }
+
+/* Common geometries: 256 B page, 4 KB and 64 KB sectors */
+XOR_DIFF_DEFINE_BLOCK_KERNELS(xor_diff_page256, 256, 4)
+XOR_DIFF_DEFINE_BLOCK_KERNELS(xor_diff_sector4k, 4096, 8)
+XOR_DIFF_DEFINE_BLOCK_KERNELS(xor_diff_sector64k, 65536, 8)
+
 #endif /* XOR_DIFF_ENABLE_INLINE */
 
 /* =============================================================================
@@ -322,8 +1717,31 @@ static inline bool xor_diff_is_aligned(const void* ptr, size_t alignment) {
 #define XOR_DIFF_DEFAULT_BLOCK_SIZE 4096
 #endif
 
+/* Define XOR_DIFF_NO_HEAP for heapless targets: a config without an arena
+ * fails xor_diff_init, and the APIs below, whose memory grows with each
+ * call's inputs, return XOR_DIFF_ERROR_MEMORY_ALLOC instead of calling
+ * malloc:
+ * - patch allocation and growth: xor_patch_alloc*, xor_patch_reserve,
+ *   create/compose/compress/decompress/optimize into a patch without
+ *   enough capacity, xor_patch_deserialize (use views instead)
+ * - xor_diff_flash_plan_build without a caller plan buffer (see
+ *   xor_diff_flash_plan_required)
+ * - xor_patched_image_open, xor_block_index_build,
+ *   xor_diff_chain_index_build, xor_wear_init, xor_diff_create_patch_cdc,
+ *   xor_diff_create_patches_multi, xor_patch_cache_*, xor_diff_shared_*
+ * xor_diff_flash_batch_apply merges patches sector by sector in the arena
+ * and keeps working, but ignores flash_allow_reorder. */
+
+/* Define XOR_DIFF_ENABLE_PROFILING for per-phase timing histograms via
+ * xor_diff_get_phase_stats; without it the timing code and API compile
+ * out. xor_diff_stats_t is the same in both builds. */
+
+#ifndef XOR_DIFF_CACHE_LINE_SIZE
+#define XOR_DIFF_CACHE_LINE_SIZE 64 /* Padding of shared counter shards */
+#endif
+
 #ifndef XOR_DIFF_MAX_PATCH_SIZE
-#define XOR_DIFF_MAX_PATCH_SIZE (1024 * 1024) /* 1MB */
+#define XOR_DIFF_MAX_PATCH_SIZE (1024 * 1024) /* 1MB, in-memory patches only */
 #endif
 
 #ifndef XOR_DIFF_VERSION_MAJOR
@@ -349,9 +1767,176 @@ static inline bool xor_diff_is_aligned(const void* ptr, size_t alignment) {
 #include <memory>
 #include <vector>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <cstring>
 
 namespace xor_diff {
 
+// Kernels specialized for one block geometry. Alignment (1, 2, 4 or 8) is
+// the guaranteed alignment of every pointer passed in and is promised to
+// the compiler; data is always moved in 64-bit words, eight per fully
+// unrolled 64-byte chunk, with compile-time bounds and a constant tail.
+template <size_t BlockSize, size_t Alignment>
+class BlockEngine {
+public:
+    static_assert(Alignment == 1 || Alignment == 2 || Alignment == 4 || Alignment == 8,
+                  "Alignment must be 1, 2, 4 or 8");
+    static_assert(BlockSize > 0 && BlockSize % Alignment == 0,
+                  "BlockSize must be a non-zero multiple of Alignment");
+    
+    static constexpr size_t block_size = BlockSize;
+    static constexpr size_t alignment = Alignment;
+    
+    // dest ^= src
+    static void xorInto(uint8_t* dest, const uint8_t* src) {
+        xorPair(dest, dest, src);
+    }
+    
+    // dest = a ^ b (patch creation); dest may equal a
+    static void xorPair(uint8_t* dest, const uint8_t* a, const uint8_t* b) {
+        uint8_t* d = aligned(dest);
+        const uint8_t* x = aligned(a);
+        const uint8_t* y = aligned(b);
+        for (size_t i = 0; i < kChunked; i += 64) {
+            XOR_DIFF_UNROLL_8
+            for (size_t j = i; j < i + 64; j += 8) {
+                storeWord(d + j, loadWord(x + j) ^ loadWord(y + j));
+            }
+        }
+        for (size_t j = kChunked; j < kWords; j += 8) {
+            storeWord(d + j, loadWord(x + j) ^ loadWord(y + j));
+        }
+        for (size_t j = kWords; j < BlockSize; j++) {
+            d[j] = static_cast<uint8_t>(x[j] ^ y[j]);
+        }
+    }
+    
+    // Apply a dense block delta in place
+    static void apply(uint8_t* data, const uint8_t* delta) {
+        xorInto(data, delta);
+    }
+    
+    static void swap(uint8_t* a, uint8_t* b) {
+        uint8_t* x = aligned(a);
+        uint8_t* y = aligned(b);
+        for (size_t i = 0; i < kChunked; i += 64) {
+            XOR_DIFF_UNROLL_8
+            for (size_t j = i; j < i + 64; j += 8) {
+                uint64_t t = loadWord(x + j);
+                storeWord(x + j, loadWord(y + j));
+                storeWord(y + j, t);
+            }
+        }
+        for (size_t j = kChunked; j < BlockSize; j++) {
+            uint8_t t = x[j];
+            x[j] = y[j];
+            y[j] = t;
+        }
+    }
+    
+    static bool isZero(const uint8_t* data) {
+        const uint8_t* p = aligned(data);
+        uint64_t acc = 0;
+        for (size_t i = 0; i < kChunked; i += 64) {
+            XOR_DIFF_UNROLL_8
+            for (size_t j = i; j < i + 64; j += 8) {
+                acc |= loadWord(p + j);
+            }
+        }
+        for (size_t j = kChunked; j < BlockSize; j++) {
+            acc |= p[j];
+        }
+        return acc == 0;
+    }
+    
+    // Constant-bound nibble-table CRC32 (same result as
+    // xor_diff_crc32_update, much smaller code, slower)
+    static uint32_t crc32Update(uint32_t state, const uint8_t* data) {
+        for (size_t i = 0; i < BlockSize; i++) {
+            state ^= data[i];
+            state = (state >> 4) ^ xor_diff_crc32_nibble_table[state & 0x0Fu];
+            state = (state >> 4) ^ xor_diff_crc32_nibble_table[state & 0x0Fu];
+        }
+        return state;
+    }
+    
+private:
+    static constexpr size_t kChunked = BlockSize / 64 * 64; // Unrolled part
+    static constexpr size_t kWords = BlockSize / 8 * 8;     // Word part
+    
+    template <typename T>
+    static T* aligned(T* ptr) {
+        return static_cast<T*>(XOR_DIFF_ASSUME_ALIGNED(ptr, Alignment));
+    }
+    
+    static uint64_t loadWord(const uint8_t* p) {
+        uint64_t w;
+        std::memcpy(&w, p, 8);
+        return w;
+    }
+    
+    static void storeWord(uint8_t* p, uint64_t w) {
+        std::memcpy(p, &w, 8);
+    }
+};
+
+template <size_t BlockSize, size_t Alignment>
+constexpr size_t BlockEngine<BlockSize, Alignment>::block_size;
+
+template <size_t BlockSize, size_t Alignment>
+constexpr size_t BlockEngine<BlockSize, Alignment>::alignment;
+
+typedef BlockEngine<256, 4> Page256Engine;
+typedef BlockEngine<4096, 8> Sector4kEngine;
+typedef BlockEngine<65536, 8> Sector64kEngine;
+
+// Non-owning byte views; constructible from std::vector, std::array,
+// std::span or anything else with data() and size()
+class ByteView {
+public:
+    ByteView(const void* data, size_t size)
+        : data_(static_cast<const uint8_t*>(data)), size_(size) {}
+    
+    template <typename Container,
+              typename = decltype(std::declval<const Container&>().data())>
+    ByteView(const Container& c)
+        : data_(reinterpret_cast<const uint8_t*>(c.data())),
+          size_(c.size() * sizeof(*c.data())) {}
+    
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+    
+private:
+    const uint8_t* data_;
+    size_t size_;
+};
+
+class MutableByteView {
+public:
+    MutableByteView(void* data, size_t size)
+        : data_(static_cast<uint8_t*>(data)), size_(size) {}
+    
+    // Only containers whose data() is writable; const ones need ByteView
+    template <typename Container,
+              typename Pointer = decltype(std::declval<Container&>().data()),
+              typename = typename std::enable_if<
+                  std::is_pointer<Pointer>::value &&
+                  !std::is_const<typename std::remove_pointer<Pointer>::type>::value &&
+                  !std::is_same<typename std::decay<Container>::type,
+                                MutableByteView>::value>::type>
+    MutableByteView(Container&& c)
+        : data_(reinterpret_cast<uint8_t*>(c.data())),
+          size_(c.size() * sizeof(*c.data())) {}
+    
+    uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+    
+private:
+    uint8_t* data_;
+    size_t size_;
+};
+
 class XorDiffException : public std::runtime_error {
 public:
     explicit XorDiffException(xor_diff_result_t result) 
@@ -371,6 +1956,12 @@ public:
         if (!patch_) throw std::bad_alloc();
     }
     
+    // Patch whose buffers come from a caller allocator (e.g. a pool)
+    Patch(size_t patch_size, const xor_diff_allocator_t* allocator)
+        : patch_(xor_patch_alloc_with(patch_size, allocator)) {
+        if (!patch_) throw std::bad_alloc();
+    }
+    
     ~Patch() { 
         if (patch_) xor_patch_free(patch_); 
     }
@@ -397,6 +1988,20 @@ public:
     xor_patch_t* get() { return patch_; }
     const xor_patch_t* get() const { return patch_; }
     
+    size_t capacity() const { return patch_ ? patch_->capacity : 0; }
+    
+    // Grow the buffer so later createPatch calls do not reallocate
+    void reserve(size_t capacity) {
+        if (!patch_) {
+            patch_ = xor_patch_alloc(0);
+            if (!patch_) throw std::bad_alloc();
+        }
+        auto result = xor_patch_reserve(patch_, capacity);
+        if (result != XOR_DIFF_SUCCESS) {
+            throw XorDiffException(result);
+        }
+    }
+    
     void validate() const {
         auto result = xor_patch_validate(patch_);
         if (result != XOR_DIFF_SUCCESS) {
@@ -408,6 +2013,64 @@ private:
     xor_patch_t* patch_;
 };
 
+class PatchCache {
+public:
+    explicit PatchCache(size_t byte_budget, const char* spill_dir = nullptr)
+        : cache_(nullptr) {
+#ifndef XOR_DIFF_ENABLE_FILE_IO
+        if (spill_dir) {
+            throw XorDiffException(XOR_DIFF_ERROR_UNSUPPORTED);
+        }
+#endif
+        cache_ = xor_patch_cache_create(byte_budget, spill_dir);
+        if (!cache_) throw std::bad_alloc();
+    }
+    
+    ~PatchCache() {
+        xor_patch_cache_destroy(cache_);
+    }
+    
+    // Delete copy operations
+    PatchCache(const PatchCache&) = delete;
+    PatchCache& operator=(const PatchCache&) = delete;
+    
+    xor_patch_cache_t* get() { return cache_; }
+    
+private:
+    xor_patch_cache_t* cache_;
+};
+
+class SharedEngine {
+public:
+    explicit SharedEngine(const xor_diff_config_t& config = xor_diff_default_config(),
+                          size_t shard_count = 0)
+        : shared_(xor_diff_shared_create(&config, shard_count)) {
+        if (!shared_) throw std::bad_alloc();
+    }
+    
+    ~SharedEngine() {
+        xor_diff_shared_destroy(shared_);
+    }
+    
+    // Delete copy operations
+    SharedEngine(const SharedEngine&) = delete;
+    SharedEngine& operator=(const SharedEngine&) = delete;
+    
+    xor_diff_shared_t* get() { return shared_; }
+    
+    xor_diff_stats_t getStats() const {
+        xor_diff_stats_t stats;
+        auto result = xor_diff_shared_get_stats(shared_, &stats);
+        if (result != XOR_DIFF_SUCCESS) {
+            throw XorDiffException(result);
+        }
+        return stats;
+    }
+    
+private:
+    xor_diff_shared_t* shared_;
+};
+
 class XorDiffEngine {
 public:
     explicit XorDiffEngine(const xor_diff_config_t& config = xor_diff_default_config()) {
@@ -417,6 +2080,14 @@ public:
         }
     }
     
+    // Per-thread engine backed by a shared engine; must not outlive it
+    explicit XorDiffEngine(SharedEngine& shared) {
+        auto result = xor_diff_shared_acquire(shared.get(), &ctx_);
+        if (result != XOR_DIFF_SUCCESS) {
+            throw XorDiffException(result);
+        }
+    }
+    
     ~XorDiffEngine() {
         xor_diff_cleanup(&ctx_);
     }
@@ -438,7 +2109,7 @@ public:
     }
     
     Patch createPatch(const void* source, const void* target, size_t size) {
-        Patch patch(size);
+        Patch patch(ctx_.config.enable_sparse ? 0 : size);
         auto result = xor_diff_create_patch(&ctx_, source, target, size, patch.get());
         if (result != XOR_DIFF_SUCCESS) {
             throw XorDiffException(result);
@@ -453,6 +2124,35 @@ public:
         }
     }
     
+    void swapInPlace(MutableByteView a, MutableByteView b) {
+        if (a.size() != b.size()) {
+            throw XorDiffException(XOR_DIFF_ERROR_INVALID_SIZE);
+        }
+        swapInPlace(a.data(), b.data(), a.size());
+    }
+    
+    // Create into a reusable patch; its buffer only grows when needed
+    void createPatch(ByteView source, ByteView target, Patch& out) {
+        if (source.size() != target.size()) {
+            throw XorDiffException(XOR_DIFF_ERROR_INVALID_SIZE);
+        }
+        if (!out.get()) {
+            out.reserve(0);
+        }
+        auto result = xor_diff_create_patch(&ctx_, source.data(), target.data(),
+                                            source.size(), out.get());
+        if (result != XOR_DIFF_SUCCESS) {
+            throw XorDiffException(result);
+        }
+    }
+    
+    void applyPatch(const Patch& patch, MutableByteView data) {
+        if (!patch.get() || data.size() < patch.get()->header.data_size) {
+            throw XorDiffException(XOR_DIFF_ERROR_INVALID_SIZE);
+        }
+        applyPatch(patch, data.data());
+    }
+    
     xor_diff_stats_t getStats() const {
         xor_diff_stats_t stats;
         auto result = xor_diff_get_stats(&ctx_, &stats);
@@ -466,6 +2166,14 @@ public:
         xor_diff_reset_stats(&ctx_);
     }
     
+    // Consult cache before computing diffs; the cache must outlive the engine
+    void setPatchCache(PatchCache& cache) {
+        auto result = xor_diff_set_patch_cache(&ctx_, cache.get());
+        if (result != XOR_DIFF_SUCCESS) {
+            throw XorDiffException(result);
+        }
+    }
+    
 private:
     xor_diff_context_t ctx_;
 };